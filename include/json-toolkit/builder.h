@@ -0,0 +1,171 @@
+// Copyright (C) 2019 Vincent Chambrin
+// This file is part of the json-toolkit library
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#ifndef JSONTOOLKIT_BUILDER_H
+#define JSONTOOLKIT_BUILDER_H
+
+#include "json-toolkit/json.h"
+
+namespace json
+{
+
+/*!
+ * \class Builder
+ * \brief constructs a Json document in place
+ *
+ * The Builder has the same interface as the parser backends and the
+ * GenericWriter, every call returning the builder itself.
+ * Values are moved into their container, which is only allocated
+ * when it is complete.
+ *
+ * \code
+ * Json doc = Builder().start_object()
+ *     .key("name").value("Alice")
+ *     .key("languages").start_array().value("C++").value("JSON").end_array()
+ *   .end_object().build();
+ * \endcode
+ */
+class Builder
+{
+public:
+  Builder() = default;
+  Builder(const Builder&) = delete;
+  ~Builder() = default;
+
+  Builder& value(std::nullptr_t) { return insert(Json(nullptr)); }
+  Builder& value(bool val) { return insert(Json(val)); }
+  Builder& value(int val) { return insert(Json(val)); }
+  Builder& value(double val) { return insert(Json(val)); }
+  Builder& value(const char* str) { return insert(Json(str)); }
+  Builder& value(const std::string& str) { return insert(Json(str)); }
+  Builder& value(std::string&& str) { return insert(Json(std::move(str))); }
+  Builder& value(Json val) { return insert(std::move(val)); }
+
+  Builder& start_object();
+  Builder& key(std::string k);
+  Builder& end_object();
+
+  Builder& start_array();
+  Builder& end_array();
+
+  Builder& reserve(size_t n);
+
+  inline bool done() const { return m_frames.empty() && m_done; }
+  Json build();
+
+  Builder& operator=(const Builder&) = delete;
+
+protected:
+  Builder& insert(Json&& val);
+
+private:
+  struct Frame
+  {
+    JsonType type;
+    bool has_key;
+    std::vector<Json> elements;
+    std::vector<std::pair<std::string, Json>> fields;
+  };
+
+  std::vector<Frame> m_frames;
+  Json m_result = nullptr;
+  bool m_done = false;
+};
+
+inline Builder& Builder::start_object()
+{
+  m_frames.push_back(Frame{ JsonType::Object, false, {}, {} });
+  return *this;
+}
+
+inline Builder& Builder::key(std::string k)
+{
+  if (m_frames.empty() || m_frames.back().type != JsonType::Object || m_frames.back().has_key)
+    throw std::runtime_error{ "Builder::key() : invalid builder state" };
+
+  m_frames.back().fields.emplace_back(std::move(k), Json(nullptr));
+  m_frames.back().has_key = true;
+  return *this;
+}
+
+inline Builder& Builder::end_object()
+{
+  if (m_frames.empty() || m_frames.back().type != JsonType::Object || m_frames.back().has_key)
+    throw std::runtime_error{ "Builder::end_object() : invalid builder state" };
+
+  Json object{ details::ObjectNode::create(std::move(m_frames.back().fields)) };
+  m_frames.pop_back();
+  return insert(std::move(object));
+}
+
+inline Builder& Builder::start_array()
+{
+  m_frames.push_back(Frame{ JsonType::Array, false, {}, {} });
+  return *this;
+}
+
+inline Builder& Builder::end_array()
+{
+  if (m_frames.empty() || m_frames.back().type != JsonType::Array)
+    throw std::runtime_error{ "Builder::end_array() : invalid builder state" };
+
+  Json array{ std::make_shared<details::ArrayNode>(std::move(m_frames.back().elements)) };
+  m_frames.pop_back();
+  return insert(std::move(array));
+}
+
+// Reserves room for n elements or fields in the current container.
+inline Builder& Builder::reserve(size_t n)
+{
+  if (m_frames.empty())
+    throw std::runtime_error{ "Builder::reserve() : no container" };
+
+  if (m_frames.back().type == JsonType::Array)
+    m_frames.back().elements.reserve(n);
+  else
+    m_frames.back().fields.reserve(n);
+
+  return *this;
+}
+
+inline Json Builder::build()
+{
+  if (!done())
+    throw std::runtime_error{ "Builder::build() : incomplete document" };
+
+  m_done = false;
+  return std::move(m_result);
+}
+
+inline Builder& Builder::insert(Json&& val)
+{
+  if (m_frames.empty())
+  {
+    if (m_done)
+      throw std::runtime_error{ "Builder : document is already complete" };
+
+    m_result = std::move(val);
+    m_done = true;
+  }
+  else if (m_frames.back().type == JsonType::Array)
+  {
+    m_frames.back().elements.push_back(std::move(val));
+  }
+  else
+  {
+    Frame& frame = m_frames.back();
+
+    if (!frame.has_key)
+      throw std::runtime_error{ "Builder : missing object key" };
+
+    frame.fields.back().second = std::move(val);
+    frame.has_key = false;
+  }
+
+  return *this;
+}
+
+} // namespace json
+
+#endif // !JSONTOOLKIT_BUILDER_H
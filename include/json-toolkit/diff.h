@@ -0,0 +1,294 @@
+// Copyright (C) 2019 Vincent Chambrin
+// This file is part of the json-toolkit library
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#ifndef JSONTOOLKIT_DIFF_H
+#define JSONTOOLKIT_DIFF_H
+
+#include "json-toolkit/pointer.h"
+
+namespace json
+{
+
+Json diff(const Json& from, const Json& to);
+
+namespace details
+{
+
+class Differ
+{
+public:
+  // arrays whose differing parts are larger than this (in number of
+  // pairs of elements) are not aligned with a longest common subsequence
+  static const size_t max_lcs_size = 1 << 20;
+
+  Json result = Array();
+
+public:
+  void diff(const JsonView& from, const JsonView& to, std::string& path);
+
+protected:
+  void add(const std::string& op, const std::string& path, const JsonView& value);
+  void remove(const std::string& path);
+
+  void diff_objects(const JsonView& from, const JsonView& to, std::string& path);
+  void diff_arrays(const JsonView& from, const JsonView& to, std::string& path);
+
+  size_t hash(const JsonView& value);
+  static bool same(const JsonView& a, const JsonView& b);
+  static bool equal(const JsonView& a, size_t hash_a, const JsonView& b, size_t hash_b);
+
+protected:
+  // hashes of the containers that are not frozen
+  std::unordered_map<const Node*, size_t> hashes;
+};
+
+// json::hash() only memoizes the hash of frozen containers; the documents
+// are not modified during a diff, so the others are memoized here.
+inline size_t Differ::hash(const JsonView& value)
+{
+  if (!value.isArray() && !value.isObject())
+    return json::hash(value);
+
+  auto* node = static_cast<const ContainerNode*>(value.json()->impl().get());
+
+  if (node->frozen)
+    return json::hash(value);
+
+  auto it = hashes.find(node);
+
+  if (it != hashes.end())
+    return it->second;
+
+  const size_t result = compute_hash(value, [this](const JsonView& e) { return hash(e); });
+  hashes[node] = result;
+  return result;
+}
+
+// Tells whether two values are equal without visiting containers
+// that are not frozen: false does not mean that they differ.
+inline bool Differ::same(const JsonView& a, const JsonView& b)
+{
+  if (a.type() != b.type())
+    return false;
+
+  if (a.json() && b.json() && a.json()->impl() == b.json()->impl())
+    return true;
+
+  if (a.isArray() || a.isObject())
+    return cached_hash(a) != 0 && cached_hash(b) != 0 && a == b;
+
+  return a == b;
+}
+
+inline bool Differ::equal(const JsonView& a, size_t hash_a, const JsonView& b, size_t hash_b)
+{
+  if (hash_a != hash_b)
+    return false;
+
+  if (a.json() && b.json() && a.json()->impl() == b.json()->impl())
+    return true;
+
+  return a == b;
+}
+
+inline void Differ::add(const std::string& op, const std::string& path, const JsonView& value)
+{
+  result.push(Object{ { "op", op }, { "path", path }, { "value", value.toJson() } });
+}
+
+inline void Differ::remove(const std::string& path)
+{
+  result.push(Object{ { "op", "remove" }, { "path", path } });
+}
+
+inline void Differ::diff(const JsonView& from, const JsonView& to, std::string& path)
+{
+  if (from.json() && to.json() && from.json()->impl() == to.json()->impl())
+    return;
+
+  if (from.type() != to.type())
+    return add("replace", path, to);
+
+  // the hashes of frozen containers are memoized, equal ones are skipped;
+  // other containers are visited, skipping the children they share
+  if (from.isObject())
+  {
+    if (!same(from, to))
+      diff_objects(from, to, path);
+  }
+  else if (from.isArray())
+  {
+    if (!same(from, to))
+      diff_arrays(from, to, path);
+  }
+  else if (from != to)
+  {
+    add("replace", path, to);
+  }
+}
+
+inline void Differ::diff_objects(const JsonView& from, const JsonView& to, std::string& path)
+{
+  const size_t size = path.size();
+  auto from_it = from.fields().begin();
+  auto to_it = to.fields().begin();
+  const auto from_end = from.fields().end();
+  const auto to_end = to.fields().end();
+
+  // keys are iterated in the same (sorted) order in both objects
+  while (from_it != from_end || to_it != to_end)
+  {
+    const int c = from_it == from_end ? 1 : (to_it == to_end ? -1 : from_it.key().compare(to_it.key()));
+
+    if (c < 0)
+    {
+      append_pointer_token(path, from_it.key());
+      remove(path);
+      ++from_it;
+    }
+    else if (c > 0)
+    {
+      append_pointer_token(path, to_it.key());
+      add("add", path, to_it.value());
+      ++to_it;
+    }
+    else
+    {
+      append_pointer_token(path, from_it.key());
+      diff(from_it.value(), to_it.value(), path);
+      ++from_it;
+      ++to_it;
+    }
+
+    path.resize(size);
+  }
+}
+
+inline void Differ::diff_arrays(const JsonView& from, const JsonView& to, std::string& path)
+{
+  std::vector<JsonView> a;
+  std::vector<JsonView> b;
+
+  for (JsonView e : from.elements())
+    a.push_back(e);
+
+  for (JsonView e : to.elements())
+    b.push_back(e);
+
+  // common prefix and suffix
+  size_t begin = 0;
+  while (begin < a.size() && begin < b.size() && same(a[begin], b[begin]))
+    ++begin;
+
+  size_t a_end = a.size();
+  size_t b_end = b.size();
+  while (a_end > begin && b_end > begin && same(a[a_end - 1], b[b_end - 1]))
+  {
+    --a_end;
+    --b_end;
+  }
+
+  const size_t m = a_end - begin;
+  const size_t n = b_end - begin;
+  const size_t size = path.size();
+
+  auto element_path = [&path, size](size_t index) -> std::string& {
+    path.resize(size);
+    append_pointer_token(path, std::to_string(index));
+    return path;
+  };
+
+  if (m * n > max_lcs_size)
+  {
+    // elements are compared pairwise
+    const size_t common = std::min(m, n);
+
+    for (size_t i(0); i < common; ++i)
+      diff(a[begin + i], b[begin + i], element_path(begin + i));
+
+    for (size_t i(m); i > common; --i)
+      remove(element_path(begin + i - 1));
+
+    for (size_t j(common); j < n; ++j)
+      add("add", element_path(begin + j), b[begin + j]);
+
+    path.resize(size);
+    return;
+  }
+
+  // the remaining elements are matched by their hash
+  std::vector<size_t> ha(a.size());
+  std::vector<size_t> hb(b.size());
+
+  for (size_t i(begin); i < a_end; ++i)
+    ha[i] = hash(a[i]);
+
+  for (size_t j(begin); j < b_end; ++j)
+    hb[j] = hash(b[j]);
+
+  // lcs[i * (n + 1) + j] is the length of the longest common subsequence
+  // of the elements of a from i and the elements of b from j
+  std::vector<uint32_t> lcs((m + 1) * (n + 1), 0);
+  auto at = [&lcs, n](size_t i, size_t j) -> uint32_t& { return lcs[i * (n + 1) + j]; };
+
+  for (size_t i(m); i-- > 0; )
+  {
+    for (size_t j(n); j-- > 0; )
+    {
+      if (equal(a[begin + i], ha[begin + i], b[begin + j], hb[begin + j]))
+        at(i, j) = at(i + 1, j + 1) + 1;
+      else
+        at(i, j) = std::max(at(i + 1, j), at(i, j + 1));
+    }
+  }
+
+  size_t i = 0;
+  size_t j = 0;
+  size_t index = begin;
+
+  while (i < m || j < n)
+  {
+    if (i < m && j < n && at(i, j) == at(i + 1, j + 1) + (equal(a[begin + i], ha[begin + i], b[begin + j], hb[begin + j]) ? 1 : 0))
+    {
+      // matching elements, or elements that can be transformed
+      // into each other without shortening the common subsequence
+      diff(a[begin + i], b[begin + j], element_path(index));
+      ++i;
+      ++j;
+      ++index;
+    }
+    else if (j == n || (i < m && at(i + 1, j) >= at(i, j + 1)))
+    {
+      remove(element_path(index));
+      ++i;
+    }
+    else
+    {
+      add("add", element_path(index), b[begin + j]);
+      ++j;
+      ++index;
+    }
+  }
+
+  path.resize(size);
+}
+
+} // namespace details
+
+// Returns a JSON Patch (RFC 6902) transforming from into to.
+// Values shared by both documents at the same path are skipped without
+// being visited, as are equal frozen containers. The elements of arrays
+// are aligned by their hashes, memoized for the duration of the diff.
+// Values of the patch are shared with to.
+inline Json diff(const Json& from, const Json& to)
+{
+  details::Differ differ;
+  std::string path;
+  differ.diff(from, to, path);
+  return differ.result;
+}
+
+} // namespace json
+
+#endif // !JSONTOOLKIT_DIFF_H
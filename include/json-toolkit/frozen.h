@@ -0,0 +1,155 @@
+// Copyright (C) 2019 Vincent Chambrin
+// This file is part of the json-toolkit library
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#ifndef JSONTOOLKIT_FROZEN_H
+#define JSONTOOLKIT_FROZEN_H
+
+#include "json-toolkit/json.h"
+
+namespace json
+{
+
+/*!
+ * \class Frozen
+ * \brief a deeply immutable document
+ *
+ * A frozen document is never modified, it can be read from any number
+ * of threads without synchronization. Reads through view() do not touch
+ * any reference count nor write to any cache: objects are stored with
+ * their keys sorted, large objects are sealed (see Object::seal()) and
+ * hashes are computed when the document is frozen.
+ *
+ * Modifying a Json obtained from json() copies the containers on the
+ * path to the modified value, the frozen document is left untouched.
+ */
+class Frozen
+{
+public:
+  Frozen() : m_root(nullptr) { }
+  Frozen(const Frozen&) = default;
+  ~Frozen() = default;
+
+  inline JsonView view() const { return JsonView(m_root); }
+  inline const Json& json() const { return m_root; }
+
+  Frozen& operator=(const Frozen&) = default;
+
+protected:
+  friend Frozen freeze(const Json& value);
+  friend class AtomicFrozen;
+
+  explicit Frozen(const std::shared_ptr<details::Node>& root) : m_root(root) { }
+
+private:
+  Json m_root;
+};
+
+/*!
+ * \class AtomicFrozen
+ * \brief holds a frozen document that can be replaced while being read
+ *
+ * Readers load() a snapshot that stays valid for as long as they keep it,
+ * while a writer store()s a new version (read-copy-update).
+ */
+class AtomicFrozen
+{
+public:
+  AtomicFrozen() : m_root(Frozen().json().impl()) { }
+  explicit AtomicFrozen(const Frozen& doc) : m_root(doc.json().impl()) { }
+  AtomicFrozen(const AtomicFrozen&) = delete;
+  ~AtomicFrozen() = default;
+
+  Frozen load() const { return Frozen(std::atomic_load(&m_root)); }
+  void store(const Frozen& doc) { std::atomic_store(&m_root, doc.json().impl()); }
+  Frozen exchange(const Frozen& doc) { return Frozen(std::atomic_exchange(&m_root, doc.json().impl())); }
+
+  AtomicFrozen& operator=(const AtomicFrozen&) = delete;
+
+private:
+  std::shared_ptr<details::Node> m_root;
+};
+
+namespace details
+{
+
+inline Json freeze(const Json& value)
+{
+  if (value.isArray())
+  {
+    auto* node = static_cast<const ArrayNode*>(value.impl().get());
+
+    if (node->frozen)
+      return value;
+
+    if (node->size() == 0)
+      return Json(ArrayNode::empty());
+
+    auto result = std::make_shared<ArrayNode>();
+    result->storage = node->storage;
+    result->integers = node->integers;
+    result->numbers = node->numbers;
+
+    if (!node->packed())
+    {
+      result->value.reserve(node->value.size());
+
+      for (const Json& e : node->value)
+        result->value.push_back(freeze(e));
+    }
+
+    result->frozen = true;
+    Json frozen{ result };
+    json::hash(frozen);
+    return frozen;
+  }
+  else if (value.isObject())
+  {
+    auto* node = static_cast<const ObjectNode*>(value.impl().get());
+
+    if (node->frozen)
+      return value;
+
+    if (node->size() == 0)
+      return Json(ObjectNode::empty());
+
+    auto result = std::make_shared<ObjectNode>();
+    std::vector<std::string> keys;
+    keys.reserve(node->size());
+
+    for (const auto& e : node->value)
+    {
+      keys.push_back(e.first);
+      result->value.emplace_hint(result->value.end(), e.first, freeze(e.second));
+    }
+
+    // objects too large to be shaped get a shape of their own,
+    // which is sealed as binary searches get costly
+    std::shared_ptr<const Shape> shape = Shape::make(std::move(keys));
+
+    if (shape->size() > Shape::max_keys)
+      shape->seal();
+
+    result->reshape(std::move(shape));
+    result->frozen = true;
+    Json frozen{ result };
+    json::hash(frozen);
+    return frozen;
+  }
+
+  // other values are never modified in place
+  return value;
+}
+
+} // namespace details
+
+// Returns a deeply immutable copy of the value.
+// Frozen parts of the value are shared rather than copied.
+inline Frozen freeze(const Json& value)
+{
+  return Frozen(details::freeze(value).impl());
+}
+
+} // namespace json
+
+#endif // !JSONTOOLKIT_FROZEN_H
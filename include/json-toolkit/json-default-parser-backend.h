@@ -105,38 +105,60 @@ struct DefaultParserBackend
     return std::stoi(str);
   }
 
+  // Unlike std::stod(), subnormal values are accepted and the decimal
+  // point is always a dot, whatever the locale of the program.
   static double parse_number(const std::string& str)
   {
-    return std::stod(str);
+    const char* begin = str.c_str();
+    char* end = nullptr;
+    errno = 0;
+#if defined(_WIN32)
+    const double result = _strtod_l(begin, &end, c_locale());
+#else
+    const double result = strtod_l(begin, &end, c_locale());
+#endif // defined(_WIN32)
+
+    if (end == begin)
+      throw std::invalid_argument{ "DefaultParserBackend::parse_number()" };
+
+    if (errno == ERANGE && (result == HUGE_VAL || result == -HUGE_VAL))
+      throw std::out_of_range{ "DefaultParserBackend::parse_number()" };
+
+    return result;
   }
 
-  static std::string remove_quotes(const std::string& str)
+#if defined(_WIN32)
+  static _locale_t c_locale()
   {
-    return std::string(str.begin() + 1, str.end() - 1);
+    static const _locale_t static_instance = _create_locale(LC_NUMERIC, "C");
+    return static_instance;
   }
-
-  void writeField(const json::Json& value)
+#else
+  static locale_t c_locale()
   {
-    assert(stack.back().isString());
-
-    std::string key = stack.back().toString();
-    stack.pop_back();
-
-    assert(stack.back().isObject());
+    static const locale_t static_instance = newlocale(LC_NUMERIC_MASK, "C", static_cast<locale_t>(0));
+    return static_instance;
+  }
+#endif // defined(_WIN32)
 
-    stack.back()[key] = value;
+  static std::string remove_quotes(const std::string& str)
+  {
+    return std::string(str.begin() + 1, str.end() - 1);
   }
 
-  void writeValue(const json::Json& value)
+  // Values of an object are written in the last field of the frame,
+  // which is created by key().
+  void writeValue(json::Json&& value)
   {
-    if (stack.back().isString())
+    if (stack.back().isObject())
     {
-      writeField(value);
+      assert(!fields.back().empty());
+      fields.back().back().second = std::move(value);
     }
     else
     {
       assert(stack.back().isArray());
-      stack.back().push(value);
+      stack.back().push(std::move(value));
     }
   }
 
@@ -150,55 +172,71 @@ struct DefaultParserBackend
     writeValue(json::Json(val));
   }
 
+  // numbers are pushed directly so that arrays of numbers get packed
+  // without allocating a node per element
   void value(int val)
   {
-    writeValue(json::Json(val));
+    if (stack.back().isArray())
+      static_cast<json::details::ArrayNode*>(stack.back().impl().get())->push(val);
+    else
+      writeValue(json::Json(val));
   }
 
   void value(double val)
   {
-    writeValue(json::Json(val));
+    if (stack.back().isArray())
+      static_cast<json::details::ArrayNode*>(stack.back().impl().get())->push(val);
+    else
+      writeValue(json::Json(val));
   }
 
   void value(const std::string& str)
   {
-    writeValue(json::Json(str));
+    if (strings)
+      writeValue(json::Json(str, *strings));
+    else
+      writeValue(json::Json(str));
+  }
+
+  void value(std::string&& str)
+  {
+    if (strings)
+      writeValue(json::Json(str, *strings));
+    else
+      writeValue(json::Json(std::move(str)));
   }
 
   void start_object()
   {
     stack.push_back(json::Object());
+    fields.emplace_back();
   }
 
   void key(const std::string& str)
   {
     assert(stack.back().isObject());
-    stack.push_back(json::Json(str));
+    fields.back().emplace_back(str, json::Json(nullptr));
+  }
+
+  void key(std::string&& str)
+  {
+    assert(stack.back().isObject());
+    fields.back().emplace_back(std::move(str), json::Json(nullptr));
   }
 
   void end_object()
   {
+    // objects are built once all their fields are known so that
+    // objects with the same keys share the same shape
+    stack.back() = json::Json(json::details::ObjectNode::create(std::move(fields.back())));
+    fields.pop_back();
+
     if (stack.size() == 1)
       return;
 
-    auto object = stack.back();
+    json::Json object = std::move(stack.back());
     stack.pop_back();
-
-    if (stack.back().isString())
-    {
-      std::string key = stack.back().toString();
-      stack.pop_back();
-
-      assert(stack.back().isObject());
-
-      stack.back()[key] = object;
-
-    }
-    else if (stack.back().isArray())
-    {
-      json::Array a = stack.back().toArray();
-      a.push(object);
-    }
+    writeValue(std::move(object));
   }
 
   void start_array()
@@ -211,27 +249,15 @@ struct DefaultParserBackend
     if (stack.size() == 1)
       return;
 
-    auto vec = stack.back();
+    json::Json vec = std::move(stack.back());
     stack.pop_back();
-
-    if (stack.back().isString())
-    {
-      std::string key = stack.back().toString();
-      stack.pop_back();
-
-      assert(stack.back().isObject());
-
-      stack.back()[key] = vec;
-
-    }
-    else if (stack.back().isArray())
-    {
-      json::Array a = stack.back().toArray();
-      a.push(vec);
-    }
+    writeValue(std::move(vec));
   }
 
   std::vector<json::Json> stack;
+  std::vector<std::vector<std::pair<std::string, json::Json>>> fields;
+  // if not null, string values are interned in this pool
+  json::StringPool* strings = nullptr;
 };
 
 } // namespace json
@@ -2,100 +2,229 @@
 // This file is part of the json-toolkit library
 // For conditions of distribution and use, see copyright notice in LICENSE
 
+#ifndef JSONTOOLKIT_DEFAULT_WRITER_BACKEND_H
+#define JSONTOOLKIT_DEFAULT_WRITER_BACKEND_H
+
 #include "json-global-defs.h"
+#include "json-escape.h"
+#include "json-number-format.h"
 
-#include <sstream>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <string>
 
 namespace json
 {
 
-struct DefaultWriterBackend
+/*!
+ * \class BasicWriterBackend
+ * \brief formats values for the GenericWriter
+ *
+ * The derived class only provides where the text goes, through
+ * append(const char*, size_t) and append(char).
+ */
+template<typename Derived>
+struct BasicWriterBackend
 {
-  std::stringstream result_;
-
-  std::string result() { return result_.str(); }
+  bool ascii_only = false;
 
-  DefaultWriterBackend& operator<<(CharCategory c)
+  Derived& operator<<(CharCategory c)
   {
     switch (c)
     {
     case CharCategory::Space:
-      result_ << " ";
+      derived().append(' ');
       break;
     case CharCategory::NewLine:
-      result_ << "\n";
+      derived().append('\n');
       break;
     case CharCategory::LBrace:
-      result_ << "{";
+      derived().append('{');
       break;
     case CharCategory::RBrace:
-      result_ << "}";
+      derived().append('}');
       break;
     case CharCategory::LBracket:
-      result_ << "[";
+      derived().append('[');
       break;
     case CharCategory::RBracket:
-      result_ << "]";
+      derived().append(']');
       break;
     case CharCategory::Colon:
-      result_ << ":";
+      derived().append(':');
       break;
     case CharCategory::Comma:
-      result_ << ",";
+      derived().append(',');
       break;
     case CharCategory::SingleQuote:
-      result_ << "'";
+      derived().append('\'');
       break;
     case CharCategory::DoubleQuote:
-      result_ << "\"";
+      derived().append('"');
       break;
     default:
       break;
     }
 
-    return *this;
+    return derived();
   }
 
-  DefaultWriterBackend& operator<<(std::nullptr_t)
+  Derived& operator<<(std::nullptr_t)
   {
-    result_ << "null";
-    return *this;
+    derived().append("null", 4);
+    return derived();
   }
 
-  DefaultWriterBackend& operator<<(bool value)
+  Derived& operator<<(bool value)
   {
-    result_ << (value ? "true" : "false");
-    return *this;
+    if (value)
+      derived().append("true", 4);
+    else
+      derived().append("false", 5);
+    return derived();
   }
 
-  DefaultWriterBackend & operator<<(int value)
+  Derived& operator<<(int value) { return writeInteger(static_cast<int64_t>(value)); }
+  Derived& operator<<(unsigned int value) { return writeInteger(static_cast<uint64_t>(value)); }
+  Derived& operator<<(long value) { return writeInteger(static_cast<int64_t>(value)); }
+  Derived& operator<<(unsigned long value) { return writeInteger(static_cast<uint64_t>(value)); }
+  Derived& operator<<(long long value) { return writeInteger(static_cast<int64_t>(value)); }
+  Derived& operator<<(unsigned long long value) { return writeInteger(static_cast<uint64_t>(value)); }
+
+  template<typename T>
+  Derived& writeInteger(T value)
   {
-    result_ << value;
-    return *this;
+    char buffer[details::max_integer_length];
+    derived().append(buffer, details::format_integer(value, buffer));
+    return derived();
   }
 
-  DefaultWriterBackend& operator<<(double value)
+  // Numbers are written in their shortest form that reads back to the
+  // same value, integral values with a fractional part (1.0).
+  // JSON has no representation for infinities and NaN, they are written as null.
+  Derived& operator<<(double value)
   {
-    result_ << value;
-    return *this;
+    if (!std::isfinite(value))
+      return derived() << nullptr;
+
+    char buffer[details::max_double_length];
+    derived().append(buffer, details::format_double(value, buffer));
+    return derived();
   }
 
-  DefaultWriterBackend& operator<<(const std::string& str)
+  // Strings are escaped as required by RFC 8259. If ascii_only is set,
+  // non-ASCII characters are also escaped as \uXXXX sequences.
+  Derived& operator<<(const std::string& str)
   {
-    for (char c : str)
+    const char* data = str.data();
+    size_t size = str.size();
+
+    for (;;)
     {
-      if (c == '\\')
-        result_ << "\\\\";
-      else if (c == '\n')
-        result_ << "\\n";
-      else if (c == '\t')
-        result_ << "\\t";
-      else
-        result_ << c;
+      // runs of characters that need no escaping are copied at once
+      const size_t run = details::find_escape(data, size, ascii_only);
+      derived().append(data, run);
+
+      if (run == size)
+        break;
+
+      char buffer[details::max_escape_length];
+      size_t written = 0;
+      const size_t consumed = details::escape(data + run, size - run, buffer, written);
+      derived().append(buffer, written);
+
+      data += run + consumed;
+      size -= run + consumed;
     }
 
-    return *this;
+    return derived();
+  }
+
+protected:
+  inline Derived& derived() { return static_cast<Derived&>(*this); }
+};
+
+/*!
+ * \class DefaultWriterBackend
+ * \brief writes into a growable contiguous buffer
+ *
+ * Text is appended directly to a std::string, which grows geometrically.
+ * result() hands the buffer to the caller without copying it.
+ */
+struct DefaultWriterBackend : BasicWriterBackend<DefaultWriterBackend>
+{
+  std::string buffer_;
+
+  // Moves the written text out of the backend, which is left empty.
+  std::string result()
+  {
+    std::string text;
+    text.swap(buffer_);
+    return text;
+  }
+
+  inline const std::string& str() const { return buffer_; }
+  inline size_t size() const { return buffer_.size(); }
+
+  void reserve(size_t n) { buffer_.reserve(n); }
+
+  void append(const char* str, size_t n) { buffer_.append(str, n); }
+  void append(char c) { buffer_.push_back(c); }
+};
+
+/*!
+ * \class CountingWriterBackend
+ * \brief only counts the bytes that would be written
+ */
+struct CountingWriterBackend : BasicWriterBackend<CountingWriterBackend>
+{
+  size_t count = 0;
+
+  inline size_t size() const { return count; }
+
+  void append(const char* /* str */, size_t n) { count += n; }
+  void append(char /* c */) { ++count; }
+};
+
+/*!
+ * \class FixedBufferWriterBackend
+ * \brief writes into a buffer provided by the caller
+ *
+ * Throws if the text does not fit in the buffer.
+ */
+struct FixedBufferWriterBackend : BasicWriterBackend<FixedBufferWriterBackend>
+{
+  char* buffer_;
+  size_t capacity_;
+  size_t size_ = 0;
+
+  FixedBufferWriterBackend(char* buffer, size_t capacity)
+    : buffer_(buffer), capacity_(capacity)
+  {
+
+  }
+
+  inline size_t size() const { return size_; }
+
+  void append(const char* str, size_t n)
+  {
+    if (n > capacity_ - size_)
+      throw std::runtime_error{ "json::FixedBufferWriterBackend : buffer too small" };
+
+    std::memcpy(buffer_ + size_, str, n);
+    size_ += n;
+  }
+
+  void append(char c)
+  {
+    if (size_ == capacity_)
+      throw std::runtime_error{ "json::FixedBufferWriterBackend : buffer too small" };
+
+    buffer_[size_++] = c;
   }
 };
 
 } // namespace json
+
+#endif // !JSONTOOLKIT_DEFAULT_WRITER_BACKEND_H
@@ -0,0 +1,193 @@
+// Copyright (C) 2019 Vincent Chambrin
+// This file is part of the json-toolkit library
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#ifndef JSONTOOLKIT_ESCAPE_H
+#define JSONTOOLKIT_ESCAPE_H
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define JSONTOOLKIT_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace json
+{
+
+namespace details
+{
+
+inline bool needs_escape(unsigned char c, bool ascii_only)
+{
+  return c < 0x20 || c == '"' || c == '\\' || (ascii_only && c >= 0x80);
+}
+
+inline int trailing_zeros(uint32_t value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_ctz(value);
+#else
+  int result = 0;
+  while (!(value & 1))
+  {
+    value >>= 1;
+    ++result;
+  }
+  return result;
+#endif
+}
+
+/*!
+ * Returns the position of the first character that must be escaped
+ * (RFC 8259: quotation mark, reverse solidus and control characters,
+ * plus non-ASCII bytes if ascii_only), or size if there is none.
+ * Strings are scanned 16 bytes at a time with SSE2, 8 bytes at a time
+ * otherwise.
+ */
+inline size_t find_escape(const char* data, size_t size, bool ascii_only)
+{
+  size_t i = 0;
+
+#if defined(JSONTOOLKIT_SSE2)
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i control = _mm_set1_epi8(0x1F);
+  const __m128i space = _mm_set1_epi8(0x20);
+
+  for (; i + 16 <= size; i += 16)
+  {
+    const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+
+    // in ascii_only mode, bytes >= 0x80 are negative and thus lower than 0x20
+    const __m128i low = ascii_only ? _mm_cmplt_epi8(chunk, space) : _mm_cmpeq_epi8(_mm_max_epu8(chunk, control), control);
+    const __m128i mask = _mm_or_si128(low, _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)));
+    const int bits = _mm_movemask_epi8(mask);
+
+    if (bits != 0)
+      return i + static_cast<size_t>(trailing_zeros(static_cast<uint32_t>(bits)));
+  }
+#else
+  const uint64_t ones = 0x0101010101010101ull;
+  const uint64_t highs = 0x8080808080808080ull;
+
+  for (; i + 8 <= size; i += 8)
+  {
+    uint64_t chunk;
+    std::memcpy(&chunk, data + i, sizeof(chunk));
+
+    const uint64_t quotes = chunk ^ (ones * '"');
+    const uint64_t backslashes = chunk ^ (ones * '\\');
+
+    // a byte is flagged if it is lower than 0x20, or zero after the xor
+    uint64_t flags = ((chunk - ones * 0x20) & ~chunk) |
+      ((quotes - ones) & ~quotes) |
+      ((backslashes - ones) & ~backslashes);
+
+    flags &= highs;
+
+    if (ascii_only)
+      flags |= chunk & highs;
+
+    if (flags != 0)
+      break;
+  }
+#endif
+
+  for (; i < size; ++i)
+  {
+    if (needs_escape(static_cast<unsigned char>(data[i]), ascii_only))
+      return i;
+  }
+
+  return size;
+}
+
+inline char* write_unicode_escape(uint32_t code_unit, char* out)
+{
+  static const char hex[] = "0123456789abcdef";
+  out[0] = '\\';
+  out[1] = 'u';
+  out[2] = hex[(code_unit >> 12) & 0xF];
+  out[3] = hex[(code_unit >> 8) & 0xF];
+  out[4] = hex[(code_unit >> 4) & 0xF];
+  out[5] = hex[code_unit & 0xF];
+  return out + 6;
+}
+
+// Largest output of escape()
+static const size_t max_escape_length = 12;
+
+/*!
+ * Writes the escape sequence for the character at data[0], which must
+ * need escaping. Returns the number of characters consumed, which is
+ * greater than one for non-ASCII UTF-8 sequences in ascii_only mode.
+ * Invalid UTF-8 bytes are replaced by U+FFFD.
+ */
+inline size_t escape(const char* data, size_t size, char* out, size_t& written)
+{
+  const unsigned char c = static_cast<unsigned char>(data[0]);
+  char* const begin = out;
+  size_t consumed = 1;
+
+  switch (c)
+  {
+  case '"': *out++ = '\\'; *out++ = '"'; break;
+  case '\\': *out++ = '\\'; *out++ = '\\'; break;
+  case '\b': *out++ = '\\'; *out++ = 'b'; break;
+  case '\f': *out++ = '\\'; *out++ = 'f'; break;
+  case '\n': *out++ = '\\'; *out++ = 'n'; break;
+  case '\r': *out++ = '\\'; *out++ = 'r'; break;
+  case '\t': *out++ = '\\'; *out++ = 't'; break;
+  default:
+  {
+    if (c < 0x80)
+    {
+      out = write_unicode_escape(c, out);
+      break;
+    }
+
+    const size_t length = c >= 0xF0 ? 4 : (c >= 0xE0 ? 3 : (c >= 0xC0 ? 2 : 0));
+    uint32_t code_point = length == 4 ? (c & 0x07) : (length == 3 ? (c & 0x0F) : (c & 0x1F));
+    bool valid = length != 0 && length <= size && c < 0xF5;
+
+    for (size_t i(1); valid && i < length; ++i)
+    {
+      const unsigned char cc = static_cast<unsigned char>(data[i]);
+      valid = (cc & 0xC0) == 0x80;
+      code_point = (code_point << 6) | (cc & 0x3F);
+    }
+
+    // overlong encodings and surrogates
+    static const uint32_t min_code_point[] = { 0, 0, 0x80, 0x800, 0x10000 };
+    valid = valid && code_point >= min_code_point[length] && code_point <= 0x10FFFF && (code_point < 0xD800 || code_point > 0xDFFF);
+
+    if (!valid)
+    {
+      out = write_unicode_escape(0xFFFD, out);
+    }
+    else if (code_point >= 0x10000)
+    {
+      code_point -= 0x10000;
+      out = write_unicode_escape(0xD800 + (code_point >> 10), out);
+      out = write_unicode_escape(0xDC00 + (code_point & 0x3FF), out);
+      consumed = length;
+    }
+    else
+    {
+      out = write_unicode_escape(code_point, out);
+      consumed = length;
+    }
+  }
+  }
+
+  written = static_cast<size_t>(out - begin);
+  return consumed;
+}
+
+} // namespace details
+
+} // namespace json
+
+#endif // !JSONTOOLKIT_ESCAPE_H
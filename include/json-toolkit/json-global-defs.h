@@ -5,6 +5,8 @@
 #ifndef JSONTOOLKIT_GLOBAL_DEFS_H
 #define JSONTOOLKIT_GLOBAL_DEFS_H
 
+#include <cstdint>
+#include <cstring>
 #include <map>
 #include <string>
 #include <vector>
@@ -34,6 +36,54 @@ enum class CharCategory {
   Other,
 };
 
+namespace details
+{
+
+// MurmurHash64A, reading 8 bytes at a time
+inline uint64_t hash_bytes(const char* str, size_t len, uint64_t seed = 0)
+{
+  const uint64_t m = 0xc6a4a7935bd1e995ULL;
+  const int r = 47;
+
+  uint64_t h = seed ^ (len * m);
+
+  const char* end = str + (len & ~size_t(7));
+
+  for (; str != end; str += 8)
+  {
+    uint64_t k;
+    std::memcpy(&k, str, 8);
+
+    k *= m;
+    k ^= k >> r;
+    k *= m;
+
+    h ^= k;
+    h *= m;
+  }
+
+  if (len & 7)
+  {
+    uint64_t k = 0;
+    std::memcpy(&k, str, len & 7);
+    h ^= k;
+    h *= m;
+  }
+
+  h ^= h >> r;
+  h *= m;
+  h ^= h >> r;
+
+  return h;
+}
+
+inline size_t hash_combine(size_t seed, size_t value)
+{
+  return seed ^ (value + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+}
+
+} // namespace details
+
 } // namespace json
 
 #endif // !JSONTOOLKIT_GLOBAL_DEFS_H
\ No newline at end of file
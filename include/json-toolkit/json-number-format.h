@@ -0,0 +1,427 @@
+// Copyright (C) 2019 Vincent Chambrin
+// This file is part of the json-toolkit library
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#ifndef JSONTOOLKIT_NUMBER_FORMAT_H
+#define JSONTOOLKIT_NUMBER_FORMAT_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace json
+{
+
+namespace details
+{
+
+// "00" to "99", used to write two digits at a time
+inline const char* digit_pairs()
+{
+  static const char table[] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+  return table;
+}
+
+inline int leading_zeros(uint64_t value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_clzll(value);
+#else
+  int result = 0;
+  for (uint64_t mask = uint64_t(1) << 63; mask && !(value & mask); mask >>= 1)
+    ++result;
+  return result;
+#endif
+}
+
+// Number of decimal digits, computed from the bit length.
+inline int count_digits(uint64_t value)
+{
+  static const uint64_t thresholds[] = {
+    0ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull, 100000000ull,
+    1000000000ull, 10000000000ull, 100000000000ull, 1000000000000ull, 10000000000000ull,
+    100000000000000ull, 1000000000000000ull, 10000000000000000ull, 100000000000000000ull,
+    1000000000000000000ull, 10000000000000000000ull
+  };
+
+  // log10(2) ~ 1233 / 4096
+  const int t = ((64 - leading_zeros(value | 1)) * 1233) >> 12;
+  return t - (value < thresholds[t]) + 1;
+}
+
+// Largest output of format_integer(), e.g. -9223372036854775808
+static const size_t max_integer_length = 24;
+
+// Writes the decimal representation, returns the number of characters written.
+inline size_t format_integer(uint64_t value, char* buffer)
+{
+  const char* pairs = digit_pairs();
+  const int length = count_digits(value);
+  char* out = buffer + length;
+
+  while (value >= 100)
+  {
+    const size_t i = static_cast<size_t>(value % 100) * 2;
+    value /= 100;
+    *--out = pairs[i + 1];
+    *--out = pairs[i];
+  }
+
+  if (value >= 10)
+  {
+    const size_t i = static_cast<size_t>(value) * 2;
+    *--out = pairs[i + 1];
+    *--out = pairs[i];
+  }
+  else
+  {
+    *--out = static_cast<char>('0' + value);
+  }
+
+  return static_cast<size_t>(length);
+}
+
+inline size_t format_integer(int64_t value, char* buffer)
+{
+  if (value >= 0)
+    return format_integer(static_cast<uint64_t>(value), buffer);
+
+  buffer[0] = '-';
+  return format_integer(0 - static_cast<uint64_t>(value), buffer + 1) + 1;
+}
+
+/*!
+ * Doubles are formatted with the Grisu2 algorithm (Florian Loitsch,
+ * "Printing Floating-Point Numbers Quickly and Accurately with Integers").
+ * The output always reads back to the same double, and is the shortest
+ * such representation in the vast majority of cases.
+ * No locale is involved.
+ */
+struct DiyFp
+{
+  uint64_t f;
+  int e;
+
+  DiyFp() : f(0), e(0) { }
+  DiyFp(uint64_t fp, int exp) : f(fp), e(exp) { }
+
+  static const uint64_t hidden_bit = 0x0010000000000000ull;
+  static const uint64_t significand_mask = 0x000FFFFFFFFFFFFFull;
+  static const int exponent_bias = 0x3FF + 52;
+
+  explicit DiyFp(double d)
+  {
+    uint64_t bits;
+    std::memcpy(&bits, &d, sizeof(bits));
+
+    const int biased_e = static_cast<int>((bits >> 52) & 0x7FF);
+    const uint64_t significand = bits & significand_mask;
+
+    if (biased_e != 0)
+    {
+      f = significand + hidden_bit;
+      e = biased_e - exponent_bias;
+    }
+    else
+    {
+      f = significand;
+      e = 1 - exponent_bias;
+    }
+  }
+
+  DiyFp operator-(const DiyFp& rhs) const
+  {
+    return DiyFp(f - rhs.f, e);
+  }
+
+  // Product rounded to the upper 64 bits.
+  DiyFp operator*(const DiyFp& rhs) const
+  {
+    const uint64_t m32 = 0xFFFFFFFFu;
+    const uint64_t a = f >> 32;
+    const uint64_t b = f & m32;
+    const uint64_t c = rhs.f >> 32;
+    const uint64_t d = rhs.f & m32;
+    const uint64_t ac = a * c;
+    const uint64_t bc = b * c;
+    const uint64_t ad = a * d;
+    const uint64_t bd = b * d;
+    uint64_t tmp = (bd >> 32) + (ad & m32) + (bc & m32);
+    tmp += 1u << 31;
+    return DiyFp(ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), e + rhs.e + 64);
+  }
+
+  DiyFp normalize() const
+  {
+    DiyFp result = *this;
+
+    while (!(result.f & (uint64_t(1) << 63)))
+    {
+      result.f <<= 1;
+      result.e--;
+    }
+
+    return result;
+  }
+
+  // Computes the boundaries m- and m+ of the interval of the reals
+  // that round to this double, both with the exponent of m+.
+  void boundaries(DiyFp& minus, DiyFp& plus) const
+  {
+    plus = DiyFp((f << 1) + 1, e - 1);
+
+    while (!(plus.f & (hidden_bit << 1)))
+    {
+      plus.f <<= 1;
+      plus.e--;
+    }
+
+    plus.f <<= 64 - 52 - 2;
+    plus.e -= 64 - 52 - 2;
+
+    minus = (f == hidden_bit) ? DiyFp((f << 2) - 1, e - 2) : DiyFp((f << 1) - 1, e - 1);
+    minus.f <<= minus.e - plus.e;
+    minus.e = plus.e;
+  }
+};
+
+// Returns c = 10^-k, normalized, such that the product of c with a
+// normalized DiyFp of exponent e has its exponent in [-60, -32].
+inline DiyFp cached_power(int e, int& k)
+{
+  // 10^-348, 10^-340, ..., 10^340 (generated with exact arithmetic)
+  static const struct { uint64_t f; int e; } powers[] = {
+  { 0xfa8fd5a0081c0288ull, -1220 }, { 0xbaaee17fa23ebf76ull, -1193 }, { 0x8b16fb203055ac76ull, -1166 },
+  { 0xcf42894a5dce35eaull, -1140 }, { 0x9a6bb0aa55653b2dull, -1113 }, { 0xe61acf033d1a45dfull, -1087 },
+  { 0xab70fe17c79ac6caull, -1060 }, { 0xff77b1fcbebcdc4full, -1034 }, { 0xbe5691ef416bd60cull, -1007 },
+  { 0x8dd01fad907ffc3cull, -980 }, { 0xd3515c2831559a83ull, -954 }, { 0x9d71ac8fada6c9b5ull, -927 },
+  { 0xea9c227723ee8bcbull, -901 }, { 0xaecc49914078536dull, -874 }, { 0x823c12795db6ce57ull, -847 },
+  { 0xc21094364dfb5637ull, -821 }, { 0x9096ea6f3848984full, -794 }, { 0xd77485cb25823ac7ull, -768 },
+  { 0xa086cfcd97bf97f4ull, -741 }, { 0xef340a98172aace5ull, -715 }, { 0xb23867fb2a35b28eull, -688 },
+  { 0x84c8d4dfd2c63f3bull, -661 }, { 0xc5dd44271ad3cdbaull, -635 }, { 0x936b9fcebb25c996ull, -608 },
+  { 0xdbac6c247d62a584ull, -582 }, { 0xa3ab66580d5fdaf6ull, -555 }, { 0xf3e2f893dec3f126ull, -529 },
+  { 0xb5b5ada8aaff80b8ull, -502 }, { 0x87625f056c7c4a8bull, -475 }, { 0xc9bcff6034c13053ull, -449 },
+  { 0x964e858c91ba2655ull, -422 }, { 0xdff9772470297ebdull, -396 }, { 0xa6dfbd9fb8e5b88full, -369 },
+  { 0xf8a95fcf88747d94ull, -343 }, { 0xb94470938fa89bcfull, -316 }, { 0x8a08f0f8bf0f156bull, -289 },
+  { 0xcdb02555653131b6ull, -263 }, { 0x993fe2c6d07b7facull, -236 }, { 0xe45c10c42a2b3b06ull, -210 },
+  { 0xaa242499697392d3ull, -183 }, { 0xfd87b5f28300ca0eull, -157 }, { 0xbce5086492111aebull, -130 },
+  { 0x8cbccc096f5088ccull, -103 }, { 0xd1b71758e219652cull, -77 }, { 0x9c40000000000000ull, -50 },
+  { 0xe8d4a51000000000ull, -24 }, { 0xad78ebc5ac620000ull, 3 }, { 0x813f3978f8940984ull, 30 },
+  { 0xc097ce7bc90715b3ull, 56 }, { 0x8f7e32ce7bea5c70ull, 83 }, { 0xd5d238a4abe98068ull, 109 },
+  { 0x9f4f2726179a2245ull, 136 }, { 0xed63a231d4c4fb27ull, 162 }, { 0xb0de65388cc8ada8ull, 189 },
+  { 0x83c7088e1aab65dbull, 216 }, { 0xc45d1df942711d9aull, 242 }, { 0x924d692ca61be758ull, 269 },
+  { 0xda01ee641a708deaull, 295 }, { 0xa26da3999aef774aull, 322 }, { 0xf209787bb47d6b85ull, 348 },
+  { 0xb454e4a179dd1877ull, 375 }, { 0x865b86925b9bc5c2ull, 402 }, { 0xc83553c5c8965d3dull, 428 },
+  { 0x952ab45cfa97a0b3ull, 455 }, { 0xde469fbd99a05fe3ull, 481 }, { 0xa59bc234db398c25ull, 508 },
+  { 0xf6c69a72a3989f5cull, 534 }, { 0xb7dcbf5354e9beceull, 561 }, { 0x88fcf317f22241e2ull, 588 },
+  { 0xcc20ce9bd35c78a5ull, 614 }, { 0x98165af37b2153dfull, 641 }, { 0xe2a0b5dc971f303aull, 667 },
+  { 0xa8d9d1535ce3b396ull, 694 }, { 0xfb9b7cd9a4a7443cull, 720 }, { 0xbb764c4ca7a44410ull, 747 },
+  { 0x8bab8eefb6409c1aull, 774 }, { 0xd01fef10a657842cull, 800 }, { 0x9b10a4e5e9913129ull, 827 },
+  { 0xe7109bfba19c0c9dull, 853 }, { 0xac2820d9623bf429ull, 880 }, { 0x80444b5e7aa7cf85ull, 907 },
+  { 0xbf21e44003acdd2dull, 933 }, { 0x8e679c2f5e44ff8full, 960 }, { 0xd433179d9c8cb841ull, 986 },
+  { 0x9e19db92b4e31ba9ull, 1013 }, { 0xeb96bf6ebadf77d9ull, 1039 }, { 0xaf87023b9bf0ee6bull, 1066 }
+  };
+
+  const double dk = (-61 - e) * 0.30102999566398114 + 347;
+  int ik = static_cast<int>(dk);
+
+  if (dk - ik > 0.0)
+    ++ik;
+
+  const unsigned index = static_cast<unsigned>((ik >> 3) + 1);
+  k = -(-348 + static_cast<int>(index << 3));
+  return DiyFp(powers[index].f, powers[index].e);
+}
+
+inline void grisu_round(char* buffer, int length, uint64_t delta, uint64_t rest, uint64_t ten_kappa, uint64_t wp_w)
+{
+  while (rest < wp_w && delta - rest >= ten_kappa &&
+    (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w))
+  {
+    buffer[length - 1]--;
+    rest += ten_kappa;
+  }
+}
+
+inline void digit_gen(const DiyFp& w, const DiyFp& mp, uint64_t delta, char* buffer, int& length, int& k)
+{
+  static const uint64_t pow10[] = {
+    1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull, 100000000ull,
+    1000000000ull, 10000000000ull, 100000000000ull, 1000000000000ull, 10000000000000ull,
+    100000000000000ull, 1000000000000000ull, 10000000000000000ull, 100000000000000000ull,
+    1000000000000000000ull, 10000000000000000000ull
+  };
+
+  const DiyFp one(uint64_t(1) << -mp.e, mp.e);
+  const DiyFp wp_w = mp - w;
+  uint32_t p1 = static_cast<uint32_t>(mp.f >> -one.e);
+  uint64_t p2 = mp.f & (one.f - 1);
+  int kappa = count_digits(p1);
+  length = 0;
+
+  while (kappa > 0)
+  {
+    const uint32_t divisor = static_cast<uint32_t>(pow10[kappa - 1]);
+    const uint32_t d = p1 / divisor;
+    p1 %= divisor;
+
+    if (d || length)
+      buffer[length++] = static_cast<char>('0' + d);
+
+    --kappa;
+    const uint64_t rest = (static_cast<uint64_t>(p1) << -one.e) + p2;
+
+    if (rest <= delta)
+    {
+      k += kappa;
+      grisu_round(buffer, length, delta, rest, pow10[kappa] << -one.e, wp_w.f);
+      return;
+    }
+  }
+
+  for (;;)
+  {
+    p2 *= 10;
+    delta *= 10;
+    const char d = static_cast<char>(p2 >> -one.e);
+
+    if (d || length)
+      buffer[length++] = static_cast<char>('0' + d);
+
+    p2 &= one.f - 1;
+    --kappa;
+
+    if (p2 < delta)
+    {
+      k += kappa;
+      const int index = -kappa;
+      grisu_round(buffer, length, delta, p2, one.f, wp_w.f * (index < 20 ? pow10[index] : 0));
+      return;
+    }
+  }
+}
+
+// Writes the digits of a positive double, the value being digits * 10^k.
+inline void grisu2(double value, char* buffer, int& length, int& k)
+{
+  const DiyFp v(value);
+  DiyFp minus, plus;
+  v.boundaries(minus, plus);
+
+  const DiyFp c = cached_power(plus.e, k);
+  const DiyFp w = v.normalize() * c;
+  DiyFp wp = plus * c;
+  DiyFp wm = minus * c;
+  wm.f++;
+  wp.f--;
+  digit_gen(w, wp, wp.f - wm.f, buffer, length, k);
+}
+
+inline char* write_exponent(int e, char* out)
+{
+  if (e < 0)
+  {
+    *out++ = '-';
+    e = -e;
+  }
+
+  if (e >= 100)
+  {
+    *out++ = static_cast<char>('0' + e / 100);
+    e %= 100;
+    *out++ = static_cast<char>('0' + e / 10);
+  }
+  else if (e >= 10)
+  {
+    *out++ = static_cast<char>('0' + e / 10);
+  }
+
+  *out++ = static_cast<char>('0' + e % 10);
+  return out;
+}
+
+// Lays out the digits, the value being digits * 10^k.
+// Integral values keep a fractional part so that they read back as
+// numbers rather than integers.
+inline char* prettify(char* buffer, int length, int k)
+{
+  const int kk = length + k; // position of the decimal point
+
+  if (k >= 0 && kk <= 21)
+  {
+    // 1234e7 -> 12340000000.0
+    std::memset(buffer + length, '0', static_cast<size_t>(k));
+    buffer[kk] = '.';
+    buffer[kk + 1] = '0';
+    return buffer + kk + 2;
+  }
+  else if (0 < kk && kk <= 21)
+  {
+    // 1234e-2 -> 12.34
+    std::memmove(buffer + kk + 1, buffer + kk, static_cast<size_t>(length - kk));
+    buffer[kk] = '.';
+    return buffer + length + 1;
+  }
+  else if (-6 < kk && kk <= 0)
+  {
+    // 1234e-6 -> 0.001234
+    const int offset = 2 - kk;
+    std::memmove(buffer + offset, buffer, static_cast<size_t>(length));
+    buffer[0] = '0';
+    buffer[1] = '.';
+    std::memset(buffer + 2, '0', static_cast<size_t>(offset - 2));
+    return buffer + length + offset;
+  }
+  else if (length == 1)
+  {
+    // 1e30
+    buffer[1] = 'e';
+    return write_exponent(kk - 1, buffer + 2);
+  }
+  else
+  {
+    // 1234e30 -> 1.234e33
+    std::memmove(buffer + 2, buffer + 1, static_cast<size_t>(length - 1));
+    buffer[1] = '.';
+    buffer[length + 1] = 'e';
+    return write_exponent(kk - 1, buffer + length + 2);
+  }
+}
+
+// Largest output of format_double(), e.g. -1.2345678901234567e-308
+static const size_t max_double_length = 32;
+
+// Writes the shortest representation of a finite double that reads back
+// to the same value, returns the number of characters written.
+inline size_t format_double(double value, char* buffer)
+{
+  char* out = buffer;
+
+  if (std::signbit(value))
+  {
+    *out++ = '-';
+    value = -value;
+  }
+
+  if (value == 0)
+  {
+    std::memcpy(out, "0.0", 3);
+    return static_cast<size_t>(out + 3 - buffer);
+  }
+
+  int length = 0;
+  int k = 0;
+  grisu2(value, out, length, k);
+  return static_cast<size_t>(prettify(out, length, k) - buffer);
+}
+
+} // namespace details
+
+} // namespace json
+
+#endif // !JSONTOOLKIT_NUMBER_FORMAT_H
@@ -0,0 +1,435 @@
+// Copyright (C) 2019 Vincent Chambrin
+// This file is part of the json-toolkit library
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#ifndef JSONTOOLKIT_SHAPE_H
+#define JSONTOOLKIT_SHAPE_H
+
+#include "json-toolkit/json-global-defs.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace json
+{
+
+namespace details
+{
+
+/*!
+ * \class Shape
+ * \brief describes the ordered key set of an object
+ *
+ * Objects having the same key set share the same Shape, which gives
+ * the slot of each key in the object.
+ * Keys are kept sorted, in the same order as the std::map storing the
+ * values of the object.
+ * A Shape is immutable once created, except for its lookup index
+ * which can be built at any time by seal().
+ */
+class Shape
+{
+public:
+  std::vector<std::string> keys;
+  // unique for the lifetime of the process
+  uint64_t id;
+
+public:
+  explicit Shape(std::vector<std::string>&& k);
+  Shape(const Shape&) = delete;
+  ~Shape() = default;
+
+  // objects with more keys than this are not shaped
+  static const size_t max_keys = 32;
+
+  inline size_t size() const { return keys.size(); }
+
+  int slot(const std::string& key) const;
+  int slot(const char* key, size_t length) const;
+  int slot(const char* key, size_t length, uint64_t hash) const;
+
+  bool matches(const std::vector<std::string>& k) const { return keys == k; }
+
+  static size_t hash(const std::vector<std::string>& keys);
+
+  static std::shared_ptr<const Shape> get(std::vector<std::string>&& keys);
+  static std::shared_ptr<const Shape> make(std::vector<std::string>&& keys);
+
+  void seal() const;
+  inline bool sealed() const { return m_sealed.load(std::memory_order_acquire); }
+
+  Shape& operator=(const Shape&) = delete;
+
+protected:
+  static uint32_t position(uint64_t h, int32_t displacement, size_t size);
+  bool build_index() const;
+  int search(const char* key, size_t length) const;
+  int indexed_slot(const char* key, size_t length, uint64_t hash) const;
+
+private:
+  // minimal perfect hash (hash and displace): the keys of a bucket are
+  // placed in the table by a displacement, buckets of a single key
+  // store their position directly as -(position + 1)
+  mutable std::vector<int32_t> m_displacements;
+  mutable std::vector<uint32_t> m_table;
+  mutable std::once_flag m_seal_once;
+  mutable std::atomic<bool> m_sealed{ false };
+};
+
+class ShapeRegistry
+{
+public:
+  ShapeRegistry() = default;
+  ShapeRegistry(const ShapeRegistry&) = delete;
+  ~ShapeRegistry() = default;
+
+  static ShapeRegistry& instance()
+  {
+    static ShapeRegistry static_instance;
+    return static_instance;
+  }
+
+  std::shared_ptr<const Shape> get(std::vector<std::string>&& keys);
+
+  size_t size() const
+  {
+    std::lock_guard<std::mutex> lock{ m_mutex };
+    return m_shapes.size();
+  }
+
+  ShapeRegistry& operator=(const ShapeRegistry&) = delete;
+
+protected:
+  void purge();
+
+private:
+  mutable std::mutex m_mutex;
+  std::unordered_multimap<size_t, std::weak_ptr<const Shape>> m_shapes;
+  size_t m_purge_threshold = 64;
+};
+
+inline uint64_t next_shape_id()
+{
+  static std::atomic<uint64_t> counter{ 0 };
+  return ++counter;
+}
+
+inline Shape::Shape(std::vector<std::string>&& k)
+  : keys(std::move(k)),
+    id(next_shape_id())
+{
+
+}
+
+inline int Shape::slot(const std::string& key) const
+{
+  return slot(key.data(), key.size());
+}
+
+inline int Shape::slot(const char* key, size_t length) const
+{
+  if (sealed())
+    return indexed_slot(key, length, details::hash_bytes(key, length));
+
+  return search(key, length);
+}
+
+// Same as slot() with the hash of the key already computed.
+inline int Shape::slot(const char* key, size_t length, uint64_t hash) const
+{
+  if (sealed())
+    return indexed_slot(key, length, hash);
+
+  return search(key, length);
+}
+
+inline int Shape::search(const char* key, size_t length) const
+{
+  auto it = std::lower_bound(keys.begin(), keys.end(), key, [length](const std::string& k, const char* str) {
+    return k.compare(0, k.size(), str, length) < 0;
+    });
+
+  if (it == keys.end() || it->size() != length || it->compare(0, length, key, length) != 0)
+    return -1;
+
+  return static_cast<int>(std::distance(keys.begin(), it));
+}
+
+inline size_t Shape::hash(const std::vector<std::string>& keys)
+{
+  std::hash<std::string> hasher;
+  size_t result = keys.size();
+
+  for (const std::string& k : keys)
+    result ^= hasher(k) + 0x9e3779b9 + (result << 6) + (result >> 2);
+
+  return result;
+}
+
+inline std::shared_ptr<const Shape> Shape::get(std::vector<std::string>&& keys)
+{
+  // records in an array usually share the same layout,
+  // the last shape is remembered to avoid locking the registry
+  static thread_local std::shared_ptr<const Shape> last_shape;
+
+  if (last_shape && last_shape->matches(keys))
+    return last_shape;
+
+  last_shape = ShapeRegistry::instance().get(std::move(keys));
+  return last_shape;
+}
+
+// Returns the registered shape for small key sets,
+// and a shape of its own for larger ones.
+inline std::shared_ptr<const Shape> Shape::make(std::vector<std::string>&& keys)
+{
+  if (keys.size() > max_keys)
+    return std::make_shared<const Shape>(std::move(keys));
+  return get(std::move(keys));
+}
+
+// Builds the perfect hash index of the keys, after which slot() costs
+// one hash and one string comparison. Can be called from several threads.
+inline void Shape::seal() const
+{
+  std::call_once(m_seal_once, [this]() {
+    if (build_index())
+      m_sealed.store(true, std::memory_order_release);
+  });
+}
+
+inline uint32_t Shape::position(uint64_t h, int32_t displacement, size_t size)
+{
+  if (displacement < 0)
+    return static_cast<uint32_t>(-(displacement + 1));
+
+  uint32_t x = static_cast<uint32_t>(h >> 32) + static_cast<uint32_t>(displacement) * 0x9e3779b9u;
+  x ^= x >> 16;
+  x *= 0x7feb352du;
+  x ^= x >> 15;
+  x *= 0x846ca68bu;
+  x ^= x >> 16;
+  return x % static_cast<uint32_t>(size);
+}
+
+inline bool Shape::build_index() const
+{
+  const size_t n = keys.size();
+
+  if (n == 0)
+    return false;
+
+  const size_t nb_buckets = n / 2 + 1;
+  std::vector<uint64_t> hashes(n);
+  std::vector<std::vector<uint32_t>> buckets(nb_buckets);
+
+  for (size_t i(0); i < n; ++i)
+  {
+    hashes[i] = details::hash_bytes(keys[i].data(), keys[i].size());
+    buckets[static_cast<uint32_t>(hashes[i]) % nb_buckets].push_back(static_cast<uint32_t>(i));
+  }
+
+  std::vector<uint32_t> order(nb_buckets);
+  for (size_t i(0); i < nb_buckets; ++i)
+    order[i] = static_cast<uint32_t>(i);
+
+  std::stable_sort(order.begin(), order.end(), [&buckets](uint32_t a, uint32_t b) {
+    return buckets[a].size() > buckets[b].size();
+    });
+
+  std::vector<int32_t> displacements(nb_buckets, 0);
+  std::vector<uint32_t> table(n);
+  std::vector<bool> used(n, false);
+  std::vector<uint32_t> positions;
+  size_t next_free = 0;
+
+  const int32_t max_displacement = 1 << 20;
+
+  for (uint32_t b : order)
+  {
+    const std::vector<uint32_t>& bucket = buckets[b];
+
+    if (bucket.empty())
+      break;
+
+    if (bucket.size() == 1)
+    {
+      while (used[next_free])
+        ++next_free;
+
+      used[next_free] = true;
+      table[next_free] = bucket.front();
+      displacements[b] = -static_cast<int32_t>(next_free) - 1;
+      continue;
+    }
+
+    int32_t d = 0;
+
+    for (; d < max_displacement; ++d)
+    {
+      positions.clear();
+
+      for (uint32_t k : bucket)
+      {
+        const uint32_t pos = position(hashes[k], d, n);
+
+        if (used[pos] || std::find(positions.begin(), positions.end(), pos) != positions.end())
+          break;
+
+        positions.push_back(pos);
+      }
+
+      if (positions.size() == bucket.size())
+        break;
+    }
+
+    // keys with colliding hashes, lookups fall back to binary search
+    if (d == max_displacement)
+      return false;
+
+    for (size_t i(0); i < bucket.size(); ++i)
+    {
+      used[positions[i]] = true;
+      table[positions[i]] = bucket[i];
+    }
+
+    displacements[b] = d;
+  }
+
+  m_displacements = std::move(displacements);
+  m_table = std::move(table);
+  return true;
+}
+
+inline int Shape::indexed_slot(const char* key, size_t length, uint64_t hash) const
+{
+  const int32_t d = m_displacements[static_cast<uint32_t>(hash) % m_displacements.size()];
+  const uint32_t index = m_table[position(hash, d, m_table.size())];
+  const std::string& k = keys[index];
+  return k.size() == length && std::memcmp(k.data(), key, length) == 0 ? static_cast<int>(index) : -1;
+}
+
+inline std::shared_ptr<const Shape> ShapeRegistry::get(std::vector<std::string>&& keys)
+{
+  const size_t h = Shape::hash(keys);
+
+  std::lock_guard<std::mutex> lock{ m_mutex };
+
+  auto range = m_shapes.equal_range(h);
+
+  for (auto it = range.first; it != range.second; ++it)
+  {
+    std::shared_ptr<const Shape> s = it->second.lock();
+
+    if (s && s->matches(keys))
+      return s;
+  }
+
+  auto result = std::make_shared<const Shape>(std::move(keys));
+  m_shapes.insert(std::make_pair(h, std::weak_ptr<const Shape>(result)));
+
+  if (m_shapes.size() >= m_purge_threshold)
+    purge();
+
+  return result;
+}
+
+inline void ShapeRegistry::purge()
+{
+  for (auto it = m_shapes.begin(); it != m_shapes.end(); )
+  {
+    if (it->second.expired())
+      it = m_shapes.erase(it);
+    else
+      ++it;
+  }
+
+  m_purge_threshold = std::max<size_t>(64, 2 * m_shapes.size());
+}
+
+} // namespace details
+
+/*!
+ * \class Key
+ * \brief an object key that remembers where it was last found
+ *
+ * The hash of the key is computed once, at construction.
+ * Looking up a Key in a shaped object caches the slot for that shape,
+ * so that subsequent lookups in objects of the same shape skip the
+ * key search.
+ */
+class Key
+{
+public:
+  explicit Key(std::string name) : m_name(std::move(name)), m_hash(details::hash_bytes(m_name.data(), m_name.size())), m_shape(0), m_slot(0) { }
+  explicit Key(const char* name) : Key(std::string(name)) { }
+  Key(const char* name, size_t length) : Key(std::string(name, length)) { }
+  Key(const Key& other) : m_name(other.m_name), m_hash(other.m_hash), m_shape(other.m_shape.load(std::memory_order_relaxed)), m_slot(other.m_slot.load(std::memory_order_relaxed)) { }
+  ~Key() = default;
+
+  inline const std::string& str() const { return m_name; }
+  inline size_t size() const { return m_name.size(); }
+  inline uint64_t hash() const { return m_hash; }
+
+  int slot(const details::Shape& shape) const
+  {
+    // the shape id and the slot are not stored together:
+    // another thread may have changed one of them in between
+    if (m_shape.load(std::memory_order_relaxed) == shape.id)
+    {
+      const uint32_t cached = m_slot.load(std::memory_order_relaxed);
+
+      if (cached < shape.size() && shape.keys[cached] == m_name)
+        return static_cast<int>(cached);
+    }
+
+    const int result = shape.slot(m_name.data(), m_name.size(), m_hash);
+
+    if (result != -1)
+    {
+      m_slot.store(static_cast<uint32_t>(result), std::memory_order_relaxed);
+      m_shape.store(shape.id, std::memory_order_relaxed);
+    }
+
+    return result;
+  }
+
+  Key& operator=(const Key& other)
+  {
+    m_name = other.m_name;
+    m_hash = other.m_hash;
+    m_shape.store(other.m_shape.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    m_slot.store(other.m_slot.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    return *this;
+  }
+
+private:
+  std::string m_name;
+  uint64_t m_hash;
+  // id of the shape the key was last found in, and its slot in that shape
+  mutable std::atomic<uint64_t> m_shape;
+  mutable std::atomic<uint32_t> m_slot;
+};
+
+namespace literals
+{
+
+// Keys should be stored, for example in a static variable,
+// for their cache to be effective.
+inline Key operator""_key(const char* name, size_t length)
+{
+  return Key(name, length);
+}
+
+} // namespace literals
+
+} // namespace json
+
+#endif // !JSONTOOLKIT_SHAPE_H
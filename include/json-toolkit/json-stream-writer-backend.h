@@ -0,0 +1,188 @@
+// Copyright (C) 2019 Vincent Chambrin
+// This file is part of the json-toolkit library
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#ifndef JSONTOOLKIT_STREAM_WRITER_BACKEND_H
+#define JSONTOOLKIT_STREAM_WRITER_BACKEND_H
+
+#include "json-default-writer-backend.h"
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <unistd.h>
+#endif
+
+namespace json
+{
+
+/*!
+ * \class BufferedWriterBackend
+ * \brief writes through a fixed-size buffer flushed to a sink
+ *
+ * The memory used does not depend on the size of the output.
+ * The Sink provides write(const char*, size_t), which must write
+ * everything or throw.
+ * The destructor flushes the remaining text but ignores errors,
+ * flush() must be called to get them.
+ */
+template<typename Sink>
+class BufferedWriterBackend : public BasicWriterBackend<BufferedWriterBackend<Sink>>
+{
+public:
+  static const size_t default_buffer_size = 64 * 1024;
+
+  explicit BufferedWriterBackend(Sink sink, size_t buffer_size = default_buffer_size)
+    : m_sink(std::move(sink)),
+      m_buffer(new char[buffer_size > 0 ? buffer_size : 1]),
+      m_capacity(buffer_size > 0 ? buffer_size : 1)
+  {
+
+  }
+
+  BufferedWriterBackend(const BufferedWriterBackend&) = delete;
+
+  ~BufferedWriterBackend()
+  {
+    try
+    {
+      flush();
+    }
+    catch (...)
+    {
+
+    }
+  }
+
+  inline Sink& sink() { return m_sink; }
+
+  // Number of bytes written, including those not flushed yet.
+  inline size_t size() const { return m_flushed + m_size; }
+
+  void append(const char* str, size_t n)
+  {
+    if (n > m_capacity - m_size)
+    {
+      flush();
+
+      // large chunks bypass the buffer
+      if (n >= m_capacity)
+      {
+        m_sink.write(str, n);
+        m_flushed += n;
+        return;
+      }
+    }
+
+    std::memcpy(m_buffer.get() + m_size, str, n);
+    m_size += n;
+  }
+
+  void append(char c)
+  {
+    if (m_size == m_capacity)
+      flush();
+
+    m_buffer[m_size++] = c;
+  }
+
+  void flush()
+  {
+    if (m_size == 0)
+      return;
+
+    const size_t n = m_size;
+    m_size = 0;
+    m_sink.write(m_buffer.get(), n);
+    m_flushed += n;
+  }
+
+  BufferedWriterBackend& operator=(const BufferedWriterBackend&) = delete;
+
+private:
+  Sink m_sink;
+  std::unique_ptr<char[]> m_buffer;
+  size_t m_capacity;
+  size_t m_size = 0;
+  size_t m_flushed = 0;
+};
+
+template<typename Sink>
+const size_t BufferedWriterBackend<Sink>::default_buffer_size;
+
+namespace details
+{
+
+struct StreamSink
+{
+  std::ostream* stream;
+
+  StreamSink(std::ostream& out) : stream(&out) { }
+
+  void write(const char* data, size_t n)
+  {
+    if (!stream->write(data, static_cast<std::streamsize>(n)))
+      throw std::runtime_error{ "json::StreamWriterBackend : write failed" };
+  }
+};
+
+struct FileSink
+{
+  FILE* file;
+
+  FileSink(FILE* f) : file(f) { }
+
+  void write(const char* data, size_t n)
+  {
+    if (std::fwrite(data, 1, n, file) != n)
+      throw std::runtime_error{ "json::FileWriterBackend : write failed" };
+  }
+};
+
+#ifndef _WIN32
+
+struct FdSink
+{
+  int fd;
+
+  FdSink(int f) : fd(f) { }
+
+  void write(const char* data, size_t n)
+  {
+    while (n > 0)
+    {
+      const ssize_t written = ::write(fd, data, n);
+
+      if (written < 0)
+      {
+        if (errno == EINTR)
+          continue;
+
+        throw std::runtime_error{ "json::FdWriterBackend : write failed" };
+      }
+
+      data += written;
+      n -= static_cast<size_t>(written);
+    }
+  }
+};
+
+#endif // !_WIN32
+
+} // namespace details
+
+typedef BufferedWriterBackend<details::StreamSink> StreamWriterBackend;
+typedef BufferedWriterBackend<details::FileSink> FileWriterBackend;
+
+#ifndef _WIN32
+typedef BufferedWriterBackend<details::FdSink> FdWriterBackend;
+#endif // !_WIN32
+
+} // namespace json
+
+#endif // !JSONTOOLKIT_STREAM_WRITER_BACKEND_H
@@ -6,10 +6,20 @@
 #define JSONTOOLKIT_JSON_H
 
 #include "json-toolkit/json-global-defs.h"
+#include "json-toolkit/json-shape.h"
 
+#include <atomic>
+#include <condition_variable>
+#include <initializer_list>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
+#if __cplusplus >= 201703L || defined(JSONTOOLKIT_CXX17)
+#include <string_view>
+#endif // __cplusplus >= 201703L || defined(JSONTOOLKIT_CXX17)
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 namespace json
@@ -41,16 +51,64 @@ public:
   Node& operator=(const Node&) = delete;
 };
 
+class Teardown;
+
+} // namespace details
+
+class Json;
+
+namespace details
+{
+void own(Json& value);
 } // namespace details
 
 class Array;
 class Object;
+class StringPool;
+
+/*!
+ * \class Span
+ * \brief a read-only view over contiguous values
+ */
+template<typename T>
+class Span
+{
+public:
+  Span() : m_data(nullptr), m_size(0) { }
+  Span(const T* data, size_t size) : m_data(data), m_size(size) { }
+  Span(const Span&) = default;
+  ~Span() = default;
+
+  inline const T* data() const { return m_data; }
+  inline size_t size() const { return m_size; }
+  inline bool empty() const { return m_size == 0; }
+
+  inline const T* begin() const { return m_data; }
+  inline const T* end() const { return m_data + m_size; }
+
+  inline const T& operator[](size_t index) const { return m_data[index]; }
+
+  Span& operator=(const Span&) = default;
+
+private:
+  const T* m_data;
+  size_t m_size;
+};
 
+/*!
+ * \class Json
+ * \brief a reference to a JSON value
+ *
+ * Copies of a Json share the same value, modifying one of them
+ * modifies the others. The only exception are frozen documents
+ * (see freeze()): copies made before the modification do not see it.
+ */
 class Json
 {
 public:
   Json();
   Json(const Json&) = default;
+  Json(Json&& other) noexcept;
   ~Json() = default;
 
   Json(std::nullptr_t);
@@ -58,7 +116,9 @@ public:
   Json(int ival);
   Json(double nval);
   Json(const std::string& str);
+  Json(std::string&& str);
   Json(const char* str);
+  Json(const std::string& str, StringPool& pool);
 
   inline Json(const std::shared_ptr<details::Node>& impl) : d(impl) { }
 
@@ -83,33 +143,64 @@ public:
   Json at(int index) const;
   Json& operator[](int index);
   void push(const Json& val);
+  void push(Json&& val);
+  template<typename...Args>
+  void emplace_back(Args&&... args);
   Array toArray() const;
 
   /* Object interface */
   Json& operator[](const std::string& key);
+  Json& operator[](std::string&& key);
   Json operator[](const std::string& key) const;
+  Json& operator[](const Key& key);
+  Json operator[](const Key& key) const;
+  Json& operator[](const char* key);
+  Json operator[](const char* key) const;
+#if __cplusplus >= 201703L || defined(JSONTOOLKIT_CXX17)
+  Json& operator[](std::string_view key);
+  Json operator[](std::string_view key) const;
+#endif // __cplusplus >= 201703L || defined(JSONTOOLKIT_CXX17)
+  template<typename...Args>
+  Json& emplace(std::string key, Args&&... args);
   Object toObject() const;
 
+  /* Array & Object interface */
+  void reserve(int n);
+
   inline const std::shared_ptr<details::Node>& impl() const { return d; }
 
   Json& operator=(const Json&) = default;
+  Json& operator=(Json&& other) noexcept;
 
   Json& operator=(std::nullptr_t);
   Json& operator=(bool val);
   Json& operator=(int val);
   Json& operator=(double val);
   Json& operator=(const std::string& str);
+  Json& operator=(std::string&& str);
   Json& operator=(const char* str);
 
   inline bool operator==(std::nullptr_t) const { return type() == JsonType::Null; }
 
 protected:
+  void detach();
+
+protected:
+  friend class details::Teardown;
+  friend void details::own(Json& value);
   std::shared_ptr<details::Node> d;
 };
 
 static const Json null = Json(nullptr);
 
+void set_deferred_destruction(bool enabled);
+bool deferred_destruction();
+void flush_deferred_destruction();
+
+class JsonView;
+
 int compare(const Json& lhs, const Json& rhs);
+size_t hash(const Json& value);
 
 bool operator==(const Json& lhs, const Json& rhs);
 inline bool operator!=(const Json& lhs, const Json& rhs) { return !(lhs == rhs); }
@@ -117,6 +208,15 @@ inline bool operator!=(const Json& lhs, const Json& rhs) { return !(lhs == rhs);
 namespace details
 {
 
+// Returns a shared_ptr to a node that is never destroyed.
+// The pointer has no control block: copying it does not touch
+// any reference count.
+template<typename T>
+inline std::shared_ptr<T> immortal(T* node)
+{
+  return std::shared_ptr<T>(std::shared_ptr<T>(), node);
+}
+
 class NullNode : public Node
 {
 public:
@@ -127,8 +227,8 @@ public:
 
   static std::shared_ptr<NullNode> get()
   {
-    static std::shared_ptr<NullNode> static_instance = std::make_shared<NullNode>();
-    return static_instance;
+    static NullNode* const static_instance = new NullNode();
+    return immortal(static_instance);
   }
 };
 
@@ -145,14 +245,14 @@ public:
 
   static std::shared_ptr<BooleanNode> True()
   {
-    static std::shared_ptr<BooleanNode> static_instance = std::make_shared<BooleanNode>(true);
-    return static_instance;
+    static BooleanNode* const static_instance = new BooleanNode(true);
+    return immortal(static_instance);
   }
 
   static std::shared_ptr<BooleanNode> False()
   {
-    static std::shared_ptr<BooleanNode> static_instance = std::make_shared<BooleanNode>(false);
-    return static_instance;
+    static BooleanNode* const static_instance = new BooleanNode(false);
+    return immortal(static_instance);
   }
 };
 
@@ -184,38 +284,186 @@ class StringNode : public Node
 {
 public:
   std::string value;
+  // id of the StringPool this node was interned in, 0 if it was not
+  uint64_t pool = 0;
 
 public:
-  StringNode(std::string val) : value(val) { }
+  StringNode(std::string val) : value(std::move(val)) { }
   ~StringNode() = default;
 
   JsonType type() const override { return JsonType::String; }
 };
 
-class ArrayNode : public Node
+/*!
+ * \class Fragment
+ * \brief serialized text of a container, see json::CacheFragments
+ *
+ * The text depends on the output format and, for pretty output,
+ * on the depth of the container in the document.
+ */
+struct Fragment
+{
+  // -1 for compact output, the indentation width for pretty output
+  int format;
+  size_t depth;
+  bool ascii_only;
+  std::string text;
+
+  bool matches(int f, size_t d, bool ascii) const { return format == f && depth == d && ascii_only == ascii; }
+};
+
+/*!
+ * \class ContainerNode
+ * \brief base class for arrays and objects
+ *
+ * Frozen containers memoize data computed from their content, such as
+ * their hash and their serialized text. Other containers do not, since
+ * mutating a child through another Json would not invalidate the data
+ * memoized by its parents.
+ *
+ * A frozen container is never modified: Json copies it before granting
+ * mutable access. The shared empty containers, used by frozen documents,
+ * are frozen.
+ */
+class ContainerNode : public Node
 {
 public:
+  // 0 if not computed yet
+  mutable std::atomic<size_t> hash_cache{ 0 };
+  // only accessed through std::atomic_load() and std::atomic_store(),
+  // has_fragment avoids these when there is no fragment
+  mutable std::shared_ptr<const Fragment> fragment_cache;
+  mutable std::atomic<bool> has_fragment{ false };
+  bool frozen = false;
+
+public:
+  ContainerNode() = default;
+  ~ContainerNode() = default;
+};
+
+class ArrayNode : public ContainerNode
+{
+public:
+  /*!
+   * Arrays of integers or numbers are packed in a contiguous vector.
+   * The first push of a value of another type, or any mutable access
+   * to the elements, converts the array to the generic storage.
+   */
+  enum Storage
+  {
+    Generic,
+    PackedIntegers,
+    PackedNumbers,
+  };
+
+  // generic storage, or a copy of the packed elements once they
+  // have been read through elements() const
   std::vector<Json> value;
+  std::vector<int> integers;
+  std::vector<double> numbers;
+  Storage storage = Generic;
+  mutable std::atomic<bool> mirrored{ false };
 
 public:
   ArrayNode() = default;
   ArrayNode(std::vector<Json>&& val) : value(std::move(val)) { }
-  ~ArrayNode() = default;
+  ArrayNode(std::vector<int>&& val) : integers(std::move(val)), storage(PackedIntegers) { }
+  ArrayNode(std::vector<double>&& val) : numbers(std::move(val)), storage(PackedNumbers) { }
+  ~ArrayNode();
 
   JsonType type() const override { return JsonType::Array; }
+
+  // shared immutable empty array
+  static std::shared_ptr<ArrayNode> empty()
+  {
+    static ArrayNode* const static_instance = []() {
+      ArrayNode* node = new ArrayNode();
+      node->frozen = true;
+      return node;
+    }();
+
+    return immortal(static_instance);
+  }
+
+  std::shared_ptr<ArrayNode> copy() const;
+
+  inline bool packed() const { return storage != Generic; }
+  size_t size() const;
+  Json at(size_t index) const;
+
+  std::vector<Json>& elements()
+  {
+    unpack();
+    return value;
+  }
+
+  const std::vector<Json>& elements() const;
+
+  void push(const Json& val);
+  void push(Json&& val);
+  void push(int val);
+  void push(double val);
+  void reserve(size_t n);
+
+  void unpack();
+
+protected:
+  bool accepts_packed(const Json& val) const;
 };
 
-class ObjectNode : public Node
+class ObjectNode : public ContainerNode
 {
 public:
   std::map<std::string, Json> value;
+  // key set shared with the objects having the same keys, and the values
+  // indexed by the slot of their key in the shape
+  std::shared_ptr<const Shape> shape;
+  std::vector<Json*> slots;
 
 public:
   ObjectNode() = default;
   ObjectNode(std::map<std::string, Json>&& val) : value(std::move(val)) { }
-  ~ObjectNode() = default;
+  ~ObjectNode();
 
   JsonType type() const override { return JsonType::Object; }
+
+  // shared immutable empty object
+  static std::shared_ptr<ObjectNode> empty()
+  {
+    static ObjectNode* const static_instance = []() {
+      ObjectNode* node = new ObjectNode();
+      node->frozen = true;
+      return node;
+    }();
+
+    return immortal(static_instance);
+  }
+
+  std::shared_ptr<ObjectNode> copy() const;
+
+  static std::shared_ptr<ObjectNode> create(std::vector<std::pair<std::string, Json>>&& fields);
+
+  inline bool shaped() const { return shape != nullptr; }
+  inline size_t size() const { return value.size(); }
+
+  const Json* find(const std::string& key) const;
+  const Json* find(const Key& key) const;
+  const Json* find(const char* key, size_t length) const;
+  Json& get(const std::string& key);
+  Json& get(std::string&& key);
+  Json& get(const Key& key);
+  Json& get(const char* key, size_t length);
+  Json& set(std::string&& key, Json&& val);
+
+  std::map<std::string, Json>& map();
+  void unshape();
+  void reshape();
+  void reshape(std::shared_ptr<const Shape> s);
+
+  typedef std::map<std::string, Json>::const_iterator const_iterator;
+
+  const_iterator begin() const { return value.begin(); }
+  const_iterator end() const { return value.end(); }
 };
 
 } // namespace details
@@ -225,10 +473,21 @@ class Array : public Json
 public:
   Array();
   Array(const Array&) = default;
+  Array(Array&&) = default;
   ~Array() = default;
 
   Array(const std::shared_ptr<details::Node>& impl);
+  Array(std::initializer_list<Json> values);
+  explicit Array(std::vector<int> values);
+  explicit Array(std::vector<double> values);
 
+  bool packed() const;
+  Span<int> integers() const;
+  Span<double> numbers() const;
+
+  // Packed arrays are converted to the generic storage on the first call
+  // to data(). The const overload keeps a copy of the packed elements
+  // instead, see ArrayNode::elements().
   std::vector<Json>& data();
   const std::vector<Json>& data() const;
 
@@ -239,6 +498,7 @@ public:
   inline const std::vector<Json>* operator->() const { return &data(); }
 
   Array& operator=(const Array&) = default;
+  Array& operator=(Array&&) = default;
 };
 
 class Object : public Json
@@ -246,9 +506,15 @@ class Object : public Json
 public:
   Object();
   Object(const Object&) = default;
+  Object(Object&&) = default;
   ~Object() = default;
 
   Object(const std::shared_ptr<details::Node>& obj);
+  Object(std::initializer_list<std::pair<std::string, Json>> fields);
+
+  size_t size() const;
+
+  void seal();
 
   std::map<std::string, Json>& data();
   const std::map<std::string, Json>& data() const;
@@ -260,23 +526,209 @@ public:
   inline const std::map<std::string, Json>* operator->() const { return &data(); }
 
   Object& operator=(const Object&) = default;
+  Object& operator=(Object&&) = default;
+};
+
+/*!
+ * \class JsonView
+ * \brief a borrowed, read-only reference to a Json value
+ *
+ * A JsonView offers the read interface of Json without ever touching
+ * reference counts. It must not outlive the value it refers to, and is
+ * invalidated by any modification of the containers it was obtained from.
+ * Elements of packed arrays are held by value in the view.
+ */
+class JsonView
+{
+public:
+  JsonView() : m_type(JsonType::Null), m_inline(false), m_json(nullptr) { }
+  JsonView(const Json& value) : m_type(value.type()), m_inline(false), m_json(&value) { }
+  JsonView(const JsonView&) = default;
+  ~JsonView() = default;
+
+  static JsonView fromInteger(int value);
+  static JsonView fromNumber(double value);
+
+  inline JsonType type() const { return m_type; }
+
+  inline bool isNull() const { return type() == JsonType::Null; }
+  inline bool isBoolean() const { return type() == JsonType::Boolean; }
+  inline bool isInteger() const { return type() == JsonType::Integer; }
+  inline bool isNumber() const { return type() == JsonType::Number; }
+  inline bool isString() const { return type() == JsonType::String; }
+  inline bool isArray() const { return type() == JsonType::Array; }
+  inline bool isObject() const { return type() == JsonType::Object; }
+
+  /* Value interface */
+  bool toBool() const;
+  int toInt() const;
+  double toNumber() const;
+  const std::string& toString() const;
+
+  /* Array & Object interface */
+  size_t size() const;
+
+  /* Array interface */
+  class ElementIterator
+  {
+  public:
+    ElementIterator(const details::ArrayNode* node, size_t index) : m_node(node), m_index(index) { }
+
+    JsonView operator*() const;
+
+    inline ElementIterator& operator++() { ++m_index; return *this; }
+    inline bool operator==(const ElementIterator& other) const { return m_index == other.m_index; }
+    inline bool operator!=(const ElementIterator& other) const { return m_index != other.m_index; }
+
+  private:
+    const details::ArrayNode* m_node;
+    size_t m_index;
+  };
+
+  int length() const;
+  JsonView at(int index) const;
+  inline JsonView operator[](int index) const { return at(index); }
+
+  /* Object interface */
+  class FieldIterator
+  {
+  public:
+    typedef std::pair<const std::string&, JsonView> value_type;
+
+    FieldIterator(details::ObjectNode::const_iterator it) : m_it(it) { }
+
+    inline const std::string& key() const { return m_it->first; }
+    inline JsonView value() const { return JsonView(m_it->second); }
+    inline value_type operator*() const { return value_type(key(), value()); }
+
+    inline FieldIterator& operator++() { ++m_it; return *this; }
+    inline bool operator==(const FieldIterator& other) const { return m_it == other.m_it; }
+    inline bool operator!=(const FieldIterator& other) const { return m_it != other.m_it; }
+
+  private:
+    details::ObjectNode::const_iterator m_it;
+  };
+
+  JsonView operator[](const std::string& key) const;
+  JsonView operator[](const Key& key) const;
+  JsonView operator[](const char* key) const;
+#if __cplusplus >= 201703L || defined(JSONTOOLKIT_CXX17)
+  JsonView operator[](std::string_view key) const;
+#endif // __cplusplus >= 201703L || defined(JSONTOOLKIT_CXX17)
+
+  template<typename Iterator>
+  class Range
+  {
+  public:
+    Range(Iterator b, Iterator e) : m_begin(b), m_end(e) { }
+
+    inline Iterator begin() const { return m_begin; }
+    inline Iterator end() const { return m_end; }
+
+  private:
+    Iterator m_begin;
+    Iterator m_end;
+  };
+
+  Range<ElementIterator> elements() const;
+  Range<FieldIterator> fields() const;
+
+  // Returns the Json the view refers to, or nullptr for null views
+  // and elements of packed arrays.
+  inline const Json* json() const { return m_inline ? nullptr : m_json; }
+  Json toJson() const;
+
+  JsonView& operator=(const JsonView&) = default;
+
+private:
+  JsonType m_type;
+  bool m_inline;
+  union
+  {
+    const Json* m_json;
+    int m_integer;
+    double m_number;
+  };
+};
+
+int compare(const JsonView& lhs, const JsonView& rhs);
+size_t hash(const JsonView& value);
+bool operator==(const JsonView& lhs, const JsonView& rhs);
+inline bool operator!=(const JsonView& lhs, const JsonView& rhs) { return !(lhs == rhs); }
+
+/*!
+ * \class StringPool
+ * \brief shares a single immutable node between identical strings
+ *
+ * A pool can be used for a single document or globally through global().
+ * Strings longer than max_length are never interned and, once the pool
+ * holds max_size strings, new strings are no longer interned.
+ * Two strings interned in the same pool are equal if and only if they
+ * share the same node.
+ */
+class StringPool
+{
+public:
+  explicit StringPool(size_t max_size = 4096, size_t max_length = 64);
+  StringPool(const StringPool&) = delete;
+  ~StringPool() = default;
+
+  static StringPool& global();
+
+  inline uint64_t id() const { return m_id; }
+  inline size_t max_size() const { return m_max_size; }
+  inline size_t max_length() const { return m_max_length; }
+
+  size_t size() const;
+  void clear();
+
+  std::shared_ptr<details::StringNode> get(const std::string& str);
+
+  StringPool& operator=(const StringPool&) = delete;
+
+private:
+  struct Hash
+  {
+    size_t operator()(const std::string* str) const { return std::hash<std::string>()(*str); }
+  };
+
+  struct Equal
+  {
+    bool operator()(const std::string* lhs, const std::string* rhs) const { return *lhs == *rhs; }
+  };
+
+private:
+  uint64_t m_id;
+  size_t m_max_size;
+  size_t m_max_length;
+  mutable std::mutex m_mutex;
+  std::unordered_map<const std::string*, std::shared_ptr<details::StringNode>, Hash, Equal> m_strings;
 };
 
 } // namespace json
 
+#include <algorithm>
 #include <cassert>
+#include <cstring>
+#include <iterator>
 #include <stdexcept>
 
 namespace json
 {
 
+// Every empty container gets its own node: copies of a Json share its
+// node, and must see the values added through any of them.
 inline Json::Json() : d(std::make_shared<details::ObjectNode>()) { }
+// A moved-from Json is null.
+inline Json::Json(Json&& other) noexcept : d(std::move(other.d)) { other.d = details::NullNode::get(); }
 inline Json::Json(std::nullptr_t) : d(details::NullNode::get()) { }
-inline Json::Json(bool bval) : d(std::make_shared<details::BooleanNode>(bval)) { }
+inline Json::Json(bool bval) : d(bval ? details::BooleanNode::True() : details::BooleanNode::False()) { }
 inline Json::Json(int ival) : d(std::make_shared<details::IntegerNode>(ival)) { }
 inline Json::Json(double nval) : d(std::make_shared<details::NumberNode>(nval)) { }
 inline Json::Json(const std::string& str) : d(std::make_shared<details::StringNode>(str)) { }
+inline Json::Json(std::string&& str) : d(std::make_shared<details::StringNode>(std::move(str))) { }
 inline Json::Json(const char* str) : d(std::make_shared<details::StringNode>(str)) { }
+inline Json::Json(const std::string& str, StringPool& pool) : d(pool.get(str)) { }
 
 inline bool Json::toBool() const
 {
@@ -305,25 +757,43 @@ inline const std::string& Json::toString() const
 inline int Json::length() const
 {
   assert(isArray());
-  return (int) static_cast<const details::ArrayNode*>(d.get())->value.size();
+  return (int) static_cast<const details::ArrayNode*>(d.get())->size();
 }
 
 inline Json Json::at(int index) const
 {
   assert(isArray());
-  return static_cast<const details::ArrayNode*>(d.get())->value.at(index);
+  return static_cast<const details::ArrayNode*>(d.get())->at(index);
 }
 
 inline Json& Json::operator[](int index)
 {
   assert(isArray());
-  return static_cast<details::ArrayNode*>(d.get())->value[index];
+  detach();
+  return static_cast<details::ArrayNode*>(d.get())->elements()[index];
 }
 
 inline void Json::push(const Json& val)
 {
   assert(isArray());
-  static_cast<details::ArrayNode*>(d.get())->value.push_back(val);
+  detach();
+  static_cast<details::ArrayNode*>(d.get())->push(val);
+}
+
+inline void Json::push(Json&& val)
+{
+  assert(isArray());
+  detach();
+  static_cast<details::ArrayNode*>(d.get())->push(std::move(val));
+}
+
+// Integers and numbers pushed to a packed array are stored packed.
+template<typename...Args>
+inline void Json::emplace_back(Args&&... args)
+{
+  assert(isArray());
+  detach();
+  static_cast<details::ArrayNode*>(d.get())->push(Json(std::forward<Args>(args)...));
 }
 
 inline Array Json::toArray() const
@@ -334,24 +804,154 @@ inline Array Json::toArray() const
 inline Json& Json::operator[](const std::string& key)
 {
   assert(isObject());
-  return static_cast<details::ObjectNode*>(d.get())->value[key];
+  detach();
+  return static_cast<details::ObjectNode*>(d.get())->get(key);
+}
+
+inline Json& Json::operator[](std::string&& key)
+{
+  assert(isObject());
+  detach();
+  return static_cast<details::ObjectNode*>(d.get())->get(std::move(key));
 }
 
 inline Json Json::operator[](const std::string& key) const
 {
   assert(isObject());
-  auto* impl = static_cast<details::ObjectNode*>(d.get());
-  auto it = impl->value.find(key);
-  if (it != impl->value.end())
-    return it->second;
+  const Json* result = static_cast<const details::ObjectNode*>(d.get())->find(key);
+  if (result)
+    return *result;
+  return nullptr;
+}
+
+inline Json& Json::operator[](const Key& key)
+{
+  assert(isObject());
+  detach();
+  return static_cast<details::ObjectNode*>(d.get())->get(key);
+}
+
+inline Json Json::operator[](const Key& key) const
+{
+  assert(isObject());
+  const Json* result = static_cast<const details::ObjectNode*>(d.get())->find(key);
+  if (result)
+    return *result;
+  return nullptr;
+}
+
+inline Json& Json::operator[](const char* key)
+{
+  assert(isObject());
+  detach();
+  return static_cast<details::ObjectNode*>(d.get())->get(key, std::strlen(key));
+}
+
+inline Json Json::operator[](const char* key) const
+{
+  assert(isObject());
+  const Json* result = static_cast<const details::ObjectNode*>(d.get())->find(key, std::strlen(key));
+  if (result)
+    return *result;
+  return nullptr;
+}
+
+#if __cplusplus >= 201703L || defined(JSONTOOLKIT_CXX17)
+
+inline Json& Json::operator[](std::string_view key)
+{
+  assert(isObject());
+  detach();
+  return static_cast<details::ObjectNode*>(d.get())->get(key.data(), key.size());
+}
+
+inline Json Json::operator[](std::string_view key) const
+{
+  assert(isObject());
+  const Json* result = static_cast<const details::ObjectNode*>(d.get())->find(key.data(), key.size());
+  if (result)
+    return *result;
   return nullptr;
 }
 
+#endif // __cplusplus >= 201703L || defined(JSONTOOLKIT_CXX17)
+
+// Inserts the value or replaces the existing one, like operator[].
+template<typename...Args>
+inline Json& Json::emplace(std::string key, Args&&... args)
+{
+  assert(isObject());
+  detach();
+  return static_cast<details::ObjectNode*>(d.get())->set(std::move(key), Json(std::forward<Args>(args)...));
+}
+
 inline Object Json::toObject() const
 {
   return Object(d);
 }
 
+// Objects are stored in a std::map which cannot preallocate,
+// reserve() has no effect on them.
+inline void Json::reserve(int n)
+{
+  assert(isArray() || isObject());
+  detach();
+
+  if (isArray())
+    static_cast<details::ArrayNode*>(d.get())->reserve(n);
+}
+
+// Gives a private copy of a frozen container before its modification.
+// Only the container is copied, its elements are shared and will in turn
+// be copied if they are modified through it.
+inline void Json::detach()
+{
+  if (isArray())
+  {
+    auto* node = static_cast<const details::ArrayNode*>(d.get());
+    if (node->frozen)
+      d = node->copy();
+  }
+  else if (isObject())
+  {
+    auto* node = static_cast<const details::ObjectNode*>(d.get());
+    if (node->frozen)
+      d = node->copy();
+  }
+}
+
+namespace details
+{
+
+// Makes sure the container is referenced by this Json only, copying it
+// otherwise. Unlike detach(), this breaks the sharing between copies
+// of a Json: it is used to modify a value without affecting the other
+// holders of its nodes.
+inline void own(Json& value)
+{
+  if (value.isArray())
+  {
+    auto* node = static_cast<const ArrayNode*>(value.d.get());
+    if (node->frozen || value.d.use_count() != 1)
+      value.d = node->copy();
+  }
+  else if (value.isObject())
+  {
+    auto* node = static_cast<const ObjectNode*>(value.d.get());
+    if (node->frozen || value.d.use_count() != 1)
+      value.d = node->copy();
+  }
+}
+
+} // namespace details
+
+inline Json& Json::operator=(Json&& other) noexcept
+{
+  d = std::move(other.d);
+  other.d = details::NullNode::get();
+  return *this;
+}
+
 inline Json& Json::operator=(std::nullptr_t)
 {
   d = details::NullNode::get();
@@ -382,104 +982,438 @@ inline Json& Json::operator=(const std::string& str)
   return *this;
 }
 
+inline Json& Json::operator=(std::string&& str)
+{
+  d = std::make_shared<details::StringNode>(std::move(str));
+  return *this;
+}
+
 inline Json& Json::operator=(const char* str)
 {
   d = std::make_shared<details::StringNode>(str);
   return *this;
 }
 
-template<typename T>
-int number_compare(const T* lhs_node, const T* rhs_node)
+inline JsonView JsonView::fromInteger(int value)
 {
-  const auto diff = lhs_node->value - rhs_node->value;
-  return (0 < diff) - (diff < 0);
+  JsonView result;
+  result.m_type = JsonType::Integer;
+  result.m_inline = true;
+  result.m_integer = value;
+  return result;
 }
 
-inline int array_compare(const Array& lhs, const Array& rhs)
+inline JsonView JsonView::fromNumber(double value)
 {
-  const int size_diff = lhs.length() - rhs.length();
-
-  if (size_diff != 0)
-    return (0 < size_diff) - (size_diff < 0);
+  JsonView result;
+  result.m_type = JsonType::Number;
+  result.m_inline = true;
+  result.m_number = value;
+  return result;
+}
 
-  for (int i(0); i < lhs.length(); ++i)
-  {
-    const int c = json::compare(lhs.at(i), rhs.at(i));
+inline bool JsonView::toBool() const
+{
+  assert(isBoolean());
+  return m_json->toBool();
+}
 
-    if (c != 0)
-      return c;
-  }
+inline int JsonView::toInt() const
+{
+  assert(isInteger());
+  return m_inline ? m_integer : m_json->toInt();
+}
 
-  return 0;
+inline double JsonView::toNumber() const
+{
+  assert(isNumber());
+  return m_inline ? m_number : m_json->toNumber();
 }
 
-inline int object_compare(const Object& lhs, const Object& rhs)
+inline const std::string& JsonView::toString() const
 {
-  const int size_diff = static_cast<int>(lhs.data().size()) - static_cast<int>(rhs.data().size());
+  assert(isString());
+  return m_json->toString();
+}
 
-  if (size_diff != 0)
-    return (0 < size_diff) - (size_diff < 0);
+inline size_t JsonView::size() const
+{
+  assert(isArray() || isObject());
 
-  auto lhs_it = lhs.data().begin();
-  auto rhs_it = rhs.data().begin();
+  if (isArray())
+    return static_cast<const details::ArrayNode*>(m_json->impl().get())->size();
+  else
+    return static_cast<const details::ObjectNode*>(m_json->impl().get())->size();
+}
 
-  for (; lhs_it != lhs.data().end(); ++lhs_it, ++rhs_it)
+inline JsonView JsonView::ElementIterator::operator*() const
+{
+  switch (m_node->storage)
   {
-    int c = lhs_it->first.compare(rhs_it->first);
+  case details::ArrayNode::PackedIntegers:
+    return JsonView::fromInteger(m_node->integers[m_index]);
+  case details::ArrayNode::PackedNumbers:
+    return JsonView::fromNumber(m_node->numbers[m_index]);
+  default:
+    return JsonView(m_node->value[m_index]);
+  }
+}
 
-    if (c != 0)
-      return c;
+inline int JsonView::length() const
+{
+  assert(isArray());
+  return static_cast<int>(size());
+}
 
-    c = json::compare(lhs_it->second, rhs_it->second);
+inline JsonView JsonView::at(int index) const
+{
+  assert(isArray());
 
-    if (c != 0)
-      return c;
-  }
+  auto* node = static_cast<const details::ArrayNode*>(m_json->impl().get());
 
-  return 0;
+  if (index < 0 || static_cast<size_t>(index) >= node->size())
+    throw std::out_of_range{ "JsonView::at()" };
+
+  return *ElementIterator(node, index);
 }
 
-inline int compare(const Json& lhs, const Json& rhs)
+inline JsonView JsonView::operator[](const std::string& key) const
 {
-  const int type_diff = static_cast<int>(lhs.type()) - static_cast<int>(rhs.type());
-
-  if (type_diff != 0)
-    return (0 < type_diff) - (type_diff < 0);
+  assert(isObject());
+  const Json* result = static_cast<const details::ObjectNode*>(m_json->impl().get())->find(key);
+  return result ? JsonView(*result) : JsonView();
+}
 
-  switch (lhs.type())
+inline JsonView JsonView::operator[](const Key& key) const
+{
+  assert(isObject());
+  const Json* result = static_cast<const details::ObjectNode*>(m_json->impl().get())->find(key);
+  return result ? JsonView(*result) : JsonView();
+}
+
+inline JsonView JsonView::operator[](const char* key) const
+{
+  assert(isObject());
+  const Json* result = static_cast<const details::ObjectNode*>(m_json->impl().get())->find(key, std::strlen(key));
+  return result ? JsonView(*result) : JsonView();
+}
+
+#if __cplusplus >= 201703L || defined(JSONTOOLKIT_CXX17)
+
+inline JsonView JsonView::operator[](std::string_view key) const
+{
+  assert(isObject());
+  const Json* result = static_cast<const details::ObjectNode*>(m_json->impl().get())->find(key.data(), key.size());
+  return result ? JsonView(*result) : JsonView();
+}
+
+#endif // __cplusplus >= 201703L || defined(JSONTOOLKIT_CXX17)
+
+inline JsonView::Range<JsonView::ElementIterator> JsonView::elements() const
+{
+  assert(isArray());
+  auto* node = static_cast<const details::ArrayNode*>(m_json->impl().get());
+  return Range<ElementIterator>(ElementIterator(node, 0), ElementIterator(node, node->size()));
+}
+
+inline JsonView::Range<JsonView::FieldIterator> JsonView::fields() const
+{
+  assert(isObject());
+  auto* node = static_cast<const details::ObjectNode*>(m_json->impl().get());
+  return Range<FieldIterator>(FieldIterator(node->begin()), FieldIterator(node->end()));
+}
+
+inline Json JsonView::toJson() const
+{
+  if (m_inline)
+    return isInteger() ? Json(m_integer) : Json(m_number);
+
+  return m_json ? *m_json : Json(nullptr);
+}
+
+namespace details
+{
+
+template<typename T>
+int number_compare(T lhs, T rhs)
+{
+  const auto diff = lhs - rhs;
+  return (0 < diff) - (diff < 0);
+}
+
+template<typename T>
+int packed_compare(const std::vector<T>& lhs, const std::vector<T>& rhs)
+{
+  for (size_t i(0); i < lhs.size(); ++i)
+  {
+    const int c = number_compare(lhs[i], rhs[i]);
+
+    if (c != 0)
+      return c;
+  }
+
+  return 0;
+}
+
+inline int array_compare(const JsonView& lhs, const JsonView& rhs)
+{
+  const int size_diff = lhs.length() - rhs.length();
+
+  if (size_diff != 0)
+    return (0 < size_diff) - (size_diff < 0);
+
+  auto* lhs_node = static_cast<const ArrayNode*>(lhs.json()->impl().get());
+  auto* rhs_node = static_cast<const ArrayNode*>(rhs.json()->impl().get());
+
+  if (lhs_node->storage == ArrayNode::PackedIntegers && rhs_node->storage == ArrayNode::PackedIntegers)
+    return packed_compare(lhs_node->integers, rhs_node->integers);
+  else if (lhs_node->storage == ArrayNode::PackedNumbers && rhs_node->storage == ArrayNode::PackedNumbers)
+    return packed_compare(lhs_node->numbers, rhs_node->numbers);
+
+  auto rhs_it = rhs.elements().begin();
+
+  for (JsonView e : lhs.elements())
+  {
+    const int c = json::compare(e, *rhs_it);
+
+    if (c != 0)
+      return c;
+
+    ++rhs_it;
+  }
+
+  return 0;
+}
+
+inline int object_compare(const JsonView& lhs, const JsonView& rhs)
+{
+  const int size_diff = static_cast<int>(lhs.size()) - static_cast<int>(rhs.size());
+
+  if (size_diff != 0)
+    return (0 < size_diff) - (size_diff < 0);
+
+  auto* lhs_node = static_cast<const ObjectNode*>(lhs.json()->impl().get());
+  auto* rhs_node = static_cast<const ObjectNode*>(rhs.json()->impl().get());
+
+  if (lhs_node->shaped() && lhs_node->shape == rhs_node->shape)
+  {
+    for (size_t i(0); i < lhs_node->slots.size(); ++i)
+    {
+      const int c = json::compare(*lhs_node->slots[i], *rhs_node->slots[i]);
+
+      if (c != 0)
+        return c;
+    }
+
+    return 0;
+  }
+
+  auto rhs_it = rhs.fields().begin();
+
+  for (auto lhs_it = lhs.fields().begin(); lhs_it != lhs.fields().end(); ++lhs_it, ++rhs_it)
+  {
+    int c = lhs_it.key().compare(rhs_it.key());
+
+    if (c != 0)
+      return c;
+
+    c = json::compare(lhs_it.value(), rhs_it.value());
+
+    if (c != 0)
+      return c;
+  }
+
+  return 0;
+}
+
+} // namespace details
+
+inline int array_compare(const Array& lhs, const Array& rhs)
+{
+  return details::array_compare(lhs, rhs);
+}
+
+inline int object_compare(const Object& lhs, const Object& rhs)
+{
+  return details::object_compare(lhs, rhs);
+}
+
+inline int compare(const JsonView& lhs, const JsonView& rhs)
+{
+  const int type_diff = static_cast<int>(lhs.type()) - static_cast<int>(rhs.type());
+
+  if (type_diff != 0)
+    return (0 < type_diff) - (type_diff < 0);
+
+  if (lhs.json() && rhs.json() && lhs.json()->impl() == rhs.json()->impl())
+    return 0;
+
+  switch (lhs.type())
   {
   case JsonType::Null:
     return 0;
   case JsonType::Boolean:
-    return static_cast<int>(static_cast<const details::BooleanNode*>(lhs.impl().get())->value)
-      - static_cast<int>(static_cast<const details::BooleanNode*>(rhs.impl().get())->value);
+    return static_cast<int>(lhs.toBool()) - static_cast<int>(rhs.toBool());
   case JsonType::Integer:
-    return number_compare(static_cast<const details::IntegerNode*>(lhs.impl().get()), static_cast<const details::IntegerNode*>(rhs.impl().get()));
+    return details::number_compare(lhs.toInt(), rhs.toInt());
   case JsonType::Number:
-    return number_compare(static_cast<const details::NumberNode*>(lhs.impl().get()), static_cast<const details::NumberNode*>(rhs.impl().get()));
+    return details::number_compare(lhs.toNumber(), rhs.toNumber());
   case JsonType::String:
     return lhs.toString().compare(rhs.toString());
   case JsonType::Array:
-    return array_compare(lhs.toArray(), rhs.toArray());
+    return details::array_compare(lhs, rhs);
   case JsonType::Object:
-    return object_compare(lhs.toObject(), rhs.toObject());
+    return details::object_compare(lhs, rhs);
   }
 
   assert(false);
   throw std::runtime_error{ "json::compare() : corrupted inputs" };
 }
 
-inline bool operator==(const Json& lhs, const Json& rhs)
+inline int compare(const Json& lhs, const Json& rhs)
+{
+  return json::compare(JsonView(lhs), JsonView(rhs));
+}
+
+namespace details
+{
+
+inline size_t hash_number(double value)
+{
+  // 0.0 and -0.0 compare equal
+  if (value == 0)
+    return 0;
+
+  uint64_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  return static_cast<size_t>(hash_bytes(reinterpret_cast<const char*>(&bits), sizeof(bits)));
+}
+
+inline size_t hash_string(const std::string& str)
+{
+  return static_cast<size_t>(hash_bytes(str.data(), str.size()));
+}
+
+// Children are hashed with hash_child(). The hash of a container is never 0.
+template<typename Hasher>
+inline size_t compute_hash(const JsonView& value, Hasher&& hash_child)
+{
+  size_t result = static_cast<size_t>(value.type());
+
+  switch (value.type())
+  {
+  case JsonType::Null:
+    return result;
+  case JsonType::Boolean:
+    return hash_combine(result, value.toBool() ? 1 : 2);
+  case JsonType::Integer:
+    return hash_combine(result, hash_number(value.toInt()));
+  case JsonType::Number:
+    return hash_combine(result, hash_number(value.toNumber()));
+  case JsonType::String:
+    return hash_combine(result, hash_string(value.toString()));
+  case JsonType::Array:
+  {
+    for (JsonView e : value.elements())
+      result = hash_combine(result, hash_child(e));
+    return result != 0 ? result : 1;
+  }
+  case JsonType::Object:
+  {
+    for (auto e : value.fields())
+    {
+      result = hash_combine(result, hash_string(e.first));
+      result = hash_combine(result, hash_child(e.second));
+    }
+    return result != 0 ? result : 1;
+  }
+  }
+
+  assert(false);
+  throw std::runtime_error{ "json::hash() : corrupted input" };
+}
+
+inline size_t compute_hash(const JsonView& value)
+{
+  return compute_hash(value, [](const JsonView& e) { return json::hash(e); });
+}
+
+// Returns the memoized hash of a frozen container, or 0 if it is not available.
+inline size_t cached_hash(const JsonView& value)
+{
+  if (!value.isArray() && !value.isObject())
+    return 0;
+
+  auto* node = static_cast<const ContainerNode*>(value.json()->impl().get());
+  return node->frozen ? node->hash_cache.load(std::memory_order_relaxed) : 0;
+}
+
+} // namespace details
+
+// Structural hash, values that compare equal have the same hash.
+// Only the hash of frozen arrays and objects is memoized: other containers
+// can be modified through a Json referring to one of their children,
+// which they would not notice.
+inline size_t hash(const JsonView& value)
+{
+  if (!value.isArray() && !value.isObject())
+    return details::compute_hash(value);
+
+  auto* node = static_cast<const details::ContainerNode*>(value.json()->impl().get());
+
+  // immortal nodes are shared by every thread and never written to
+  if (!node->frozen || value.json()->impl().use_count() == 0)
+    return details::compute_hash(value);
+
+  size_t result = node->hash_cache.load(std::memory_order_relaxed);
+
+  if (result == 0)
+  {
+    result = details::compute_hash(value);
+    node->hash_cache.store(result, std::memory_order_relaxed);
+  }
+
+  return result;
+}
+
+inline size_t hash(const Json& value)
 {
-  if (lhs.impl() == rhs.impl())
-    return true;
+  return json::hash(JsonView(value));
+}
 
+inline bool operator==(const JsonView& lhs, const JsonView& rhs)
+{
   if (lhs.type() != rhs.type())
     return false;
 
+  if (lhs.json() && rhs.json())
+  {
+    if (lhs.json()->impl() == rhs.json()->impl())
+      return true;
+
+    const size_t lhs_hash = details::cached_hash(lhs);
+    const size_t rhs_hash = lhs_hash != 0 ? details::cached_hash(rhs) : 0;
+
+    if (rhs_hash != 0 && lhs_hash != rhs_hash)
+      return false;
+
+    if (lhs.isString())
+    {
+      const uint64_t pool = static_cast<const details::StringNode*>(lhs.json()->impl().get())->pool;
+
+      if (pool != 0 && pool == static_cast<const details::StringNode*>(rhs.json()->impl().get())->pool)
+        return false;
+    }
+  }
+
   return json::compare(lhs, rhs) == 0;
 }
 
+inline bool operator==(const Json& lhs, const Json& rhs)
+{
+  return JsonView(lhs) == JsonView(rhs);
+}
+
 inline Array::Array() 
   : Json(std::make_shared<details::ArrayNode>())
 {
@@ -492,42 +1426,826 @@ inline Array::Array(const std::shared_ptr<details::Node>& impl)
 
 }
 
+inline Array::Array(std::initializer_list<Json> values)
+  : Json(std::make_shared<details::ArrayNode>(std::vector<Json>(values)))
+{
+
+}
+
 inline std::vector<Json>& Array::data()
 {
   assert(isArray());
-  return static_cast<details::ArrayNode*>(d.get())->value;
+  detach();
+  return static_cast<details::ArrayNode*>(d.get())->elements();
 }
 
+// Frozen packed arrays cannot be converted, read them through a JsonView.
 inline const std::vector<Json>& Array::data() const
 {
   assert(isArray());
-  return static_cast<const details::ArrayNode*>(d.get())->value;
+  return static_cast<const details::ArrayNode*>(d.get())->elements();
 }
 
-inline Object::Object()
-  : Json(std::make_shared<details::ObjectNode>())
+inline Array::Array(std::vector<int> values)
+  : Json(std::make_shared<details::ArrayNode>(std::move(values)))
 {
 
 }
 
-inline Object::Object(const std::shared_ptr<details::Node>& obj)
-  : Json(obj->type() == JsonType::Object ? obj : details::NullNode::get())
+inline Array::Array(std::vector<double> values)
+  : Json(std::make_shared<details::ArrayNode>(std::move(values)))
 {
 
 }
 
-inline std::map<std::string, Json>& Object::data()
+inline bool Array::packed() const
 {
-  assert(isObject());
-  return static_cast<details::ObjectNode*>(d.get())->value;
+  assert(isArray());
+  return static_cast<const details::ArrayNode*>(d.get())->packed();
 }
 
-inline const std::map<std::string, Json>& Object::data() const
+// Returns the elements of an array of packed integers, or an empty span.
+inline Span<int> Array::integers() const
 {
-  assert(isObject());
-  return static_cast<const details::ObjectNode*>(d.get())->value;
+  assert(isArray());
+  auto* node = static_cast<const details::ArrayNode*>(d.get());
+  if (node->storage != details::ArrayNode::PackedIntegers)
+    return Span<int>();
+  return Span<int>(node->integers.data(), node->integers.size());
 }
 
-} // namespace json
+// Returns the elements of an array of packed numbers, or an empty span.
+inline Span<double> Array::numbers() const
+{
+  assert(isArray());
+  auto* node = static_cast<const details::ArrayNode*>(d.get());
+  if (node->storage != details::ArrayNode::PackedNumbers)
+    return Span<double>();
+  return Span<double>(node->numbers.data(), node->numbers.size());
+}
+
+namespace details
+{
+
+inline size_t ArrayNode::size() const
+{
+  switch (storage)
+  {
+  case PackedIntegers:
+    return integers.size();
+  case PackedNumbers:
+    return numbers.size();
+  default:
+    return value.size();
+  }
+}
+
+// Packed elements are returned as new nodes.
+inline Json ArrayNode::at(size_t index) const
+{
+  switch (storage)
+  {
+  case PackedIntegers:
+    return Json(integers.at(index));
+  case PackedNumbers:
+    return Json(numbers.at(index));
+  default:
+    return value.at(index);
+  }
+}
+
+inline bool ArrayNode::accepts_packed(const Json& val) const
+{
+  const bool empty = storage == Generic && value.empty();
+
+  if (val.isInteger())
+    return empty || storage == PackedIntegers;
+  else if (val.isNumber())
+    return empty || storage == PackedNumbers;
+
+  return false;
+}
+
+inline void ArrayNode::push(const Json& val)
+{
+  if (!accepts_packed(val))
+    return elements().push_back(val);
+
+  if (val.isInteger())
+    push(val.toInt());
+  else
+    push(val.toNumber());
+}
+
+inline void ArrayNode::push(Json&& val)
+{
+  if (!accepts_packed(val))
+    return elements().push_back(std::move(val));
+
+  if (val.isInteger())
+    push(val.toInt());
+  else
+    push(val.toNumber());
+}
+
+// The first integer pushed to an empty array makes it packed,
+// the capacity reserved for generic elements is transferred.
+inline void ArrayNode::push(int val)
+{
+  if (storage == Generic && value.empty())
+  {
+    storage = PackedIntegers;
+    integers.reserve(value.capacity());
+    std::vector<Json>().swap(value);
+  }
+
+  if (storage != PackedIntegers)
+    return elements().push_back(Json(val));
+
+  integers.push_back(val);
+
+  if (mirrored.load(std::memory_order_relaxed))
+    value.push_back(Json(val));
+}
+
+inline void ArrayNode::push(double val)
+{
+  if (storage == Generic && value.empty())
+  {
+    storage = PackedNumbers;
+    numbers.reserve(value.capacity());
+    std::vector<Json>().swap(value);
+  }
+
+  if (storage != PackedNumbers)
+    return elements().push_back(Json(val));
+
+  numbers.push_back(val);
+
+  if (mirrored.load(std::memory_order_relaxed))
+    value.push_back(Json(val));
+}
+
+// Packed arrays copy their elements the first time they are read as Json.
+// The copy is then updated by push() and becomes the generic storage
+// when the array is unpacked, references to its elements stay valid.
+inline const std::vector<Json>& ArrayNode::elements() const
+{
+  if (!packed() || mirrored.load(std::memory_order_acquire))
+    return value;
+
+  static std::mutex mutex;
+  std::lock_guard<std::mutex> lock{ mutex };
+
+  if (!mirrored.load(std::memory_order_relaxed))
+  {
+    auto& copy = const_cast<std::vector<Json>&>(value);
+    copy.reserve(size());
+
+    if (storage == PackedIntegers)
+      copy.assign(integers.begin(), integers.end());
+    else
+      copy.assign(numbers.begin(), numbers.end());
+
+    mirrored.store(true, std::memory_order_release);
+  }
+
+  return value;
+}
+
+inline std::shared_ptr<ArrayNode> ArrayNode::copy() const
+{
+  auto result = std::make_shared<ArrayNode>();
+  if (!packed())
+    result->value = value;
+  result->integers = integers;
+  result->numbers = numbers;
+  result->storage = storage;
+  return result;
+}
+
+inline void ArrayNode::reserve(size_t n)
+{
+  if (packed() && mirrored.load(std::memory_order_relaxed))
+    value.reserve(n);
+
+  switch (storage)
+  {
+  case PackedIntegers:
+    return integers.reserve(n);
+  case PackedNumbers:
+    return numbers.reserve(n);
+  default:
+    return value.reserve(n);
+  }
+}
+
+inline void ArrayNode::unpack()
+{
+  if (!packed())
+    return;
+
+  if (!mirrored.load(std::memory_order_relaxed))
+  {
+    value.reserve(size());
+
+    if (storage == PackedIntegers)
+      value.assign(integers.begin(), integers.end());
+    else
+      value.assign(numbers.begin(), numbers.end());
+  }
+
+  integers.clear();
+  integers.shrink_to_fit();
+  numbers.clear();
+  numbers.shrink_to_fit();
+  storage = Generic;
+  mirrored.store(false, std::memory_order_relaxed);
+}
+
+} // namespace details
+
+inline Object::Object()
+  : Json(std::make_shared<details::ObjectNode>())
+{
+
+}
+
+inline Object::Object(const std::shared_ptr<details::Node>& obj)
+  : Json(obj->type() == JsonType::Object ? obj : details::NullNode::get())
+{
+
+}
+
+inline Object::Object(std::initializer_list<std::pair<std::string, Json>> fields)
+  : Json(details::ObjectNode::create(std::vector<std::pair<std::string, Json>>(fields)))
+{
+
+}
+
+inline size_t Object::size() const
+{
+  assert(isObject());
+  return static_cast<const details::ObjectNode*>(d.get())->size();
+}
+
+// Builds a perfect hash index of the keys of the object, making lookups
+// O(1) with a single string comparison. The index is shared by the objects
+// of the same shape, and is lost by the object if a key is added or the
+// non-const data() is called.
+inline void Object::seal()
+{
+  assert(isObject());
+  auto* node = static_cast<details::ObjectNode*>(d.get());
+
+  if (!node->frozen)
+    node->reshape();
+
+  if (node->shaped())
+    node->shape->seal();
+}
+
+// The caller may add or remove keys through the map:
+// the object loses its shape, its values are not moved.
+inline std::map<std::string, Json>& Object::data()
+{
+  assert(isObject());
+  detach();
+  return static_cast<details::ObjectNode*>(d.get())->map();
+}
+
+// Frozen shaped objects cannot be converted, read them through a JsonView.
+inline const std::map<std::string, Json>& Object::data() const
+{
+  assert(isObject());
+  return static_cast<const details::ObjectNode*>(d.get())->value;
+}
+
+namespace details
+{
+
+inline std::shared_ptr<ObjectNode> ObjectNode::create(std::vector<std::pair<std::string, Json>>&& fields)
+{
+  typedef std::pair<std::string, Json> Field;
+
+  std::stable_sort(fields.begin(), fields.end(), [](const Field& a, const Field& b) {
+    return a.first < b.first;
+    });
+
+  // when a key appears more than once, the last value wins
+  auto out = fields.begin();
+  for (auto it = fields.begin(); it != fields.end(); ++it)
+  {
+    if (out != fields.begin() && std::prev(out)->first == it->first)
+    {
+      std::prev(out)->second = std::move(it->second);
+    }
+    else
+    {
+      if (out != it)
+        *out = std::move(*it);
+      ++out;
+    }
+  }
+  fields.erase(out, fields.end());
+
+  std::map<std::string, Json> map;
+  std::vector<std::string> keys;
+  keys.reserve(fields.size());
+
+  for (Field& f : fields)
+  {
+    if (fields.size() <= Shape::max_keys)
+      keys.push_back(f.first);
+    map.emplace_hint(map.end(), std::move(f.first), std::move(f.second));
+  }
+
+  auto result = std::make_shared<ObjectNode>(std::move(map));
+
+  if (!keys.empty())
+    result->reshape(Shape::get(std::move(keys)));
+
+  return result;
+}
+
+inline const Json* ObjectNode::find(const std::string& key) const
+{
+  if (shaped())
+  {
+    const int s = shape->slot(key);
+    return s != -1 ? slots[s] : nullptr;
+  }
+
+  auto it = value.find(key);
+  return it != value.end() ? &(it->second) : nullptr;
+}
+
+// Shaped objects are searched without constructing a std::string.
+inline const Json* ObjectNode::find(const char* key, size_t length) const
+{
+  if (shaped())
+  {
+    const int s = shape->slot(key, length);
+    return s != -1 ? slots[s] : nullptr;
+  }
+
+  auto it = value.find(std::string(key, length));
+  return it != value.end() ? &(it->second) : nullptr;
+}
+
+inline const Json* ObjectNode::find(const Key& key) const
+{
+  if (shaped())
+  {
+    const int s = key.slot(*shape);
+    return s != -1 ? slots[s] : nullptr;
+  }
+
+  return find(key.str());
+}
+
+inline Json& ObjectNode::get(const std::string& key)
+{
+  if (shaped())
+  {
+    const int s = shape->slot(key);
+
+    if (s != -1)
+      return *slots[s];
+
+    unshape();
+  }
+
+  return value[key];
+}
+
+inline Json& ObjectNode::get(std::string&& key)
+{
+  if (shaped())
+  {
+    const int s = shape->slot(key);
+
+    if (s != -1)
+      return *slots[s];
+
+    unshape();
+  }
+
+  auto it = value.lower_bound(key);
+
+  if (it == value.end() || it->first != key)
+    it = value.emplace_hint(it, std::move(key), Json());
+
+  return it->second;
+}
+
+inline Json& ObjectNode::get(const char* key, size_t length)
+{
+  if (shaped())
+  {
+    const int s = shape->slot(key, length);
+
+    if (s != -1)
+      return *slots[s];
+  }
+
+  return get(std::string(key, length));
+}
+
+inline Json& ObjectNode::get(const Key& key)
+{
+  if (shaped())
+  {
+    const int s = key.slot(*shape);
+
+    if (s != -1)
+      return *slots[s];
+
+    unshape();
+  }
+
+  return value[key.str()];
+}
+
+inline Json& ObjectNode::set(std::string&& key, Json&& val)
+{
+  Json& result = get(std::move(key));
+  result = std::move(val);
+  return result;
+}
+
+inline std::shared_ptr<ObjectNode> ObjectNode::copy() const
+{
+  auto result = std::make_shared<ObjectNode>();
+  result->value = value;
+
+  if (shaped())
+    result->reshape(shape);
+
+  return result;
+}
+
+inline std::map<std::string, Json>& ObjectNode::map()
+{
+  unshape();
+  return value;
+}
+
+// Drops the shape, which no longer describes the keys of the object.
+// Values stay where they are, references to them remain valid.
+inline void ObjectNode::unshape()
+{
+  shape = nullptr;
+  slots.clear();
+  slots.shrink_to_fit();
+}
+
+inline void ObjectNode::reshape()
+{
+  if (shaped() || value.empty())
+    return;
+
+  std::vector<std::string> keys;
+  keys.reserve(value.size());
+
+  for (const auto& e : value)
+    keys.push_back(e.first);
+
+  reshape(Shape::make(std::move(keys)));
+}
+
+// The keys of the shape must be those of the object.
+inline void ObjectNode::reshape(std::shared_ptr<const Shape> s)
+{
+  assert(s->size() == value.size());
+
+  shape = std::move(s);
+  slots.clear();
+  slots.reserve(value.size());
+
+  for (auto& e : value)
+    slots.push_back(&e.second);
+}
+
+} // namespace details
+
+namespace details
+{
+
+inline uint64_t next_string_pool_id()
+{
+  static std::atomic<uint64_t> counter{ 0 };
+  return ++counter;
+}
+
+} // namespace details
+
+inline StringPool::StringPool(size_t max_size, size_t max_length)
+  : m_id(details::next_string_pool_id()),
+    m_max_size(max_size),
+    m_max_length(max_length)
+{
+
+}
+
+inline StringPool& StringPool::global()
+{
+  static StringPool static_instance{ 65536 };
+  return static_instance;
+}
+
+inline size_t StringPool::size() const
+{
+  std::lock_guard<std::mutex> lock{ m_mutex };
+  return m_strings.size();
+}
+
+// The pool gets a new id so that strings interned before and after
+// clear() are not compared by identity.
+inline void StringPool::clear()
+{
+  std::lock_guard<std::mutex> lock{ m_mutex };
+  m_strings.clear();
+  m_id = details::next_string_pool_id();
+}
+
+inline std::shared_ptr<details::StringNode> StringPool::get(const std::string& str)
+{
+  if (str.size() > m_max_length)
+    return std::make_shared<details::StringNode>(str);
+
+  std::lock_guard<std::mutex> lock{ m_mutex };
+
+  auto it = m_strings.find(&str);
+
+  if (it != m_strings.end())
+    return it->second;
+
+  auto result = std::make_shared<details::StringNode>(str);
+
+  if (m_strings.size() < m_max_size)
+  {
+    result->pool = m_id;
+    m_strings[&result->value] = result;
+  }
+
+  return result;
+}
+
+namespace details
+{
+
+/*!
+ * \class Teardown
+ * \brief destroys containers without recursion
+ *
+ * The destructor of a container moves its container children to a
+ * work list which is drained by the outermost destructor, so that the
+ * stack does not grow with the depth of the tree.
+ * If deferred destruction is enabled for the calling thread, the
+ * children are instead handed to the Reclaimer.
+ */
+class Teardown
+{
+public:
+  static void release(std::vector<Json>& elements, std::map<std::string, Json>& fields);
+
+protected:
+  typedef std::vector<std::shared_ptr<Node>> WorkList;
+
+  static WorkList*& current()
+  {
+    static thread_local WorkList* static_instance = nullptr;
+    return static_instance;
+  }
+
+  static void collect(Json& child, WorkList& work)
+  {
+    Node* n = child.d.get();
+
+    if (n && (n->type() == JsonType::Array || n->type() == JsonType::Object) && child.d.use_count() == 1)
+      work.push_back(std::move(child.d));
+  }
+
+  friend class Reclaimer;
+};
+
+/*!
+ * \class Reclaimer
+ * \brief frees trees on a background thread
+ */
+class Reclaimer
+{
+public:
+  struct Garbage
+  {
+    std::vector<Json> elements;
+    std::map<std::string, Json> fields;
+  };
+
+public:
+  Reclaimer() { alive() = true; }
+  Reclaimer(const Reclaimer&) = delete;
+  ~Reclaimer();
+
+  static Reclaimer& instance()
+  {
+    static Reclaimer static_instance;
+    return static_instance;
+  }
+
+  // false once the instance has been destroyed at exit
+  static std::atomic<bool>& alive()
+  {
+    static std::atomic<bool> static_flag{ false };
+    return static_flag;
+  }
+
+  static bool& enabled()
+  {
+    static thread_local bool static_flag = false;
+    return static_flag;
+  }
+
+  void push(Garbage&& g);
+  void flush();
+
+  Reclaimer& operator=(const Reclaimer&) = delete;
+
+protected:
+  void run();
+
+private:
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  std::vector<Garbage> m_queue;
+  size_t m_pending = 0;
+  bool m_stop = false;
+  std::thread m_thread;
+};
+
+inline void Teardown::release(std::vector<Json>& elements, std::map<std::string, Json>& fields)
+{
+  if (elements.empty() && fields.empty())
+    return;
+
+  if (Reclaimer::enabled() && current() == nullptr)
+  {
+    Reclaimer& reclaimer = Reclaimer::instance();
+
+    if (Reclaimer::alive())
+    {
+      Reclaimer::Garbage g;
+      g.elements.swap(elements);
+      g.fields.swap(fields);
+      reclaimer.push(std::move(g));
+      return;
+    }
+  }
+
+  WorkList*& list = current();
+
+  if (list)
+  {
+    for (Json& e : elements)
+      collect(e, *list);
+    for (auto& f : fields)
+      collect(f.second, *list);
+    return;
+  }
+
+  WorkList work;
+
+  for (Json& e : elements)
+    collect(e, work);
+  for (auto& f : fields)
+    collect(f.second, work);
+
+  if (work.empty())
+    return;
+
+  list = &work;
+
+  while (!work.empty())
+  {
+    std::shared_ptr<Node> n = std::move(work.back());
+    work.pop_back();
+    n.reset();
+  }
+
+  list = nullptr;
+}
+
+inline Reclaimer::~Reclaimer()
+{
+  {
+    std::lock_guard<std::mutex> lock{ m_mutex };
+    m_stop = true;
+  }
+
+  m_cv.notify_all();
+
+  if (m_thread.joinable())
+    m_thread.join();
+
+  alive() = false;
+}
+
+inline void Reclaimer::push(Garbage&& g)
+{
+  std::unique_lock<std::mutex> lock{ m_mutex };
+
+  if (!m_thread.joinable())
+    m_thread = std::thread(&Reclaimer::run, this);
+
+  m_queue.push_back(std::move(g));
+  ++m_pending;
+
+  if (m_queue.size() == 1)
+  {
+    lock.unlock();
+    m_cv.notify_all();
+  }
+}
+
+inline void Reclaimer::flush()
+{
+  std::unique_lock<std::mutex> lock{ m_mutex };
+  m_cv.wait(lock, [this]() { return m_pending == 0; });
+}
+
+inline void Reclaimer::run()
+{
+  std::unique_lock<std::mutex> lock{ m_mutex };
+
+  for (;;)
+  {
+    m_cv.wait(lock, [this]() { return m_stop || !m_queue.empty(); });
+
+    if (m_queue.empty())
+      return;
+
+    std::vector<Garbage> batch;
+    batch.swap(m_queue);
+    lock.unlock();
+
+    const size_t n = batch.size();
+    batch.clear();
+
+    lock.lock();
+    m_pending -= n;
+
+    if (m_pending == 0)
+      m_cv.notify_all();
+  }
+}
+
+inline ArrayNode::~ArrayNode()
+{
+  std::map<std::string, Json> no_fields;
+  Teardown::release(value, no_fields);
+}
+
+inline ObjectNode::~ObjectNode()
+{
+  std::vector<Json> no_elements;
+  Teardown::release(no_elements, value);
+}
+
+} // namespace details
+
+// Enables or disables deferred destruction for the calling thread.
+// When enabled, trees destroyed by this thread are freed by a background thread.
+inline void set_deferred_destruction(bool enabled)
+{
+  details::Reclaimer::enabled() = enabled;
+}
+
+inline bool deferred_destruction()
+{
+  return details::Reclaimer::enabled();
+}
+
+// Blocks until all the trees handed to the background thread are freed.
+inline void flush_deferred_destruction()
+{
+  details::Reclaimer::instance().flush();
+}
+
+} // namespace json
+
+namespace std
+{
+
+template<>
+struct hash<json::Json>
+{
+  size_t operator()(const json::Json& value) const
+  {
+    return json::hash(value);
+  }
+};
+
+} // namespace std
 
 #endif // !JSONTOOLKIT_JSON_H
\ No newline at end of file
@@ -0,0 +1,322 @@
+// Copyright (C) 2019 Vincent Chambrin
+// This file is part of the json-toolkit library
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#ifndef JSONTOOLKIT_PARALLEL_STRINGIFY_H
+#define JSONTOOLKIT_PARALLEL_STRINGIFY_H
+
+#include "json-toolkit/stringify.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <climits>
+#include <sys/uio.h>
+#endif // !_WIN32
+
+namespace json
+{
+
+namespace details
+{
+
+// roots with fewer elements or fields are written by a single thread
+static const size_t min_parallel_size = 1024;
+
+/*!
+ * \class TextPart
+ * \brief a piece of the output, starting at offset in text
+ */
+struct TextPart
+{
+  std::string text;
+  size_t offset = 0;
+
+  inline const char* data() const { return text.data() + offset; }
+  inline size_t size() const { return text.size() - offset; }
+};
+
+// Items are children of the root container, at depth 1.
+template<typename Writer, typename Fragments>
+void write_item(Writer& writer, const JsonView::ElementIterator& it, Fragments& fragments)
+{
+  write(writer, *it, fragments, 1);
+}
+
+template<typename Writer, typename Fragments>
+void write_item(Writer& writer, const JsonView::FieldIterator& it, Fragments& fragments)
+{
+  writer.key(it.key());
+  write(writer, it.value(), fragments, 1);
+}
+
+template<typename Writer, typename Iterator, typename Fragments>
+void write_items(Writer& writer, Iterator begin, Iterator end, Fragments& fragments)
+{
+  for (; begin != end; ++begin)
+    write_item(writer, begin, fragments);
+}
+
+// Writes the items in [begin, end) of the root container. The writer
+// opens the container, whose bracket is skipped, so that the items are
+// written at the right depth and with the right separators.
+template<typename Format, typename Iterator>
+TextPart write_chunk(JsonType type, Iterator begin, Iterator end, bool first, const Format& format, StringifyOptions options)
+{
+  GenericWriter<DefaultWriterBackend, Format> writer{ format };
+  writer.backend().ascii_only = (options & AsciiOnly) != 0;
+
+  if (type == JsonType::Array)
+    writer.start_array();
+  else
+    writer.start_object();
+
+  if (!first)
+    writer.resume();
+
+  if (options & CacheFragments)
+  {
+    FragmentRecorder<Format> fragments{ format, writer.backend().ascii_only };
+    write_items(writer, begin, end, fragments);
+  }
+  else
+  {
+    NoFragments fragments;
+    write_items(writer, begin, end, fragments);
+  }
+
+  TextPart result;
+  result.text = writer.backend().result();
+  result.offset = 1;
+  return result;
+}
+
+template<typename Format, typename Iterator>
+void write_chunks(JsonType type, Iterator begin, Iterator end, size_t size, const Format& format, StringifyOptions options, unsigned int threads, std::vector<TextPart>& parts)
+{
+  // more chunks than threads, so that a thread finishing early takes another one
+  const size_t nb_chunks = std::min<size_t>(size, 4 * threads);
+
+  std::vector<Iterator> bounds;
+  bounds.reserve(nb_chunks + 1);
+
+  Iterator it = begin;
+  size_t index = 0;
+
+  for (size_t c(0); c < nb_chunks; ++c)
+  {
+    bounds.push_back(it);
+
+    for (const size_t next = size * (c + 1) / nb_chunks; index < next; ++index)
+      ++it;
+  }
+
+  bounds.push_back(end);
+
+  const size_t first_part = parts.size();
+  parts.resize(first_part + nb_chunks);
+
+  std::atomic<size_t> next_chunk{ 0 };
+  std::exception_ptr error;
+  std::mutex error_mutex;
+
+  auto work = [&]() {
+    for (;;)
+    {
+      const size_t c = next_chunk.fetch_add(1);
+
+      if (c >= nb_chunks)
+        return;
+
+      try
+      {
+        parts[first_part + c] = write_chunk(type, bounds[c], bounds[c + 1], c == 0, format, options);
+      }
+      catch (...)
+      {
+        std::lock_guard<std::mutex> lock{ error_mutex };
+        if (!error)
+          error = std::current_exception();
+      }
+    }
+  };
+
+  std::vector<std::thread> workers;
+
+  for (unsigned int i(1); i < threads; ++i)
+    workers.emplace_back(work);
+
+  work();
+
+  for (std::thread& t : workers)
+    t.join();
+
+  if (error)
+    std::rethrow_exception(error);
+}
+
+// Returns the parts of the output: the opening bracket, the chunks of
+// the root container and the end of the output.
+template<typename Format>
+std::vector<TextPart> write_parallel(const JsonView& root, const Format& format, StringifyOptions options, unsigned int threads)
+{
+  std::vector<TextPart> parts;
+
+  // the brackets are written by a writer for the indentation of the end
+  GenericWriter<DefaultWriterBackend, Format> writer{ format };
+
+  parts.emplace_back();
+  parts.back().text = root.isArray() ? "[" : "{";
+
+  if (root.isArray())
+  {
+    writer.start_array();
+    auto elements = root.elements();
+    write_chunks(JsonType::Array, elements.begin(), elements.end(), root.size(), format, options, threads, parts);
+    writer.resume();
+    writer.end_array();
+  }
+  else
+  {
+    writer.start_object();
+    auto fields = root.fields();
+    write_chunks(JsonType::Object, fields.begin(), fields.end(), root.size(), format, options, threads, parts);
+    writer.resume();
+    writer.end_object();
+  }
+
+  parts.emplace_back();
+  parts.back().text = writer.backend().result();
+  parts.back().offset = 1;
+  return parts;
+}
+
+inline unsigned int parallel_threads(const JsonView& root, unsigned int threads)
+{
+  if (!root.isArray() && !root.isObject())
+    return 1;
+
+  if (root.size() < min_parallel_size)
+    return 1;
+
+  if (threads == 0)
+    threads = std::thread::hardware_concurrency();
+
+  return std::max(threads, 1u);
+}
+
+inline std::vector<TextPart> write_parallel(const JsonView& root, StringifyOptions options, unsigned int threads)
+{
+  if (options & Compact)
+    return write_parallel(root, CompactFormat(), options, threads);
+  else
+    return write_parallel(root, PrettyFormat(), options, threads);
+}
+
+#ifndef _WIN32
+
+inline void write_parts(int fd, const std::vector<TextPart>& parts)
+{
+#ifdef IOV_MAX
+  const size_t max_iov = IOV_MAX;
+#else
+  const size_t max_iov = 1024;
+#endif
+
+  std::vector<struct iovec> iov;
+  iov.reserve(parts.size());
+
+  for (const TextPart& p : parts)
+  {
+    if (p.size() == 0)
+      continue;
+
+    struct iovec v;
+    v.iov_base = const_cast<char*>(p.data());
+    v.iov_len = p.size();
+    iov.push_back(v);
+  }
+
+  size_t first = 0;
+
+  while (first < iov.size())
+  {
+    const size_t count = std::min(iov.size() - first, max_iov);
+    const ssize_t written = ::writev(fd, iov.data() + first, static_cast<int>(count));
+
+    if (written < 0)
+    {
+      if (errno == EINTR)
+        continue;
+
+      throw std::runtime_error{ "json::stringify_parallel_to_fd() : write failed" };
+    }
+
+    // skips what was written, a buffer may have been partially written
+    size_t n = static_cast<size_t>(written);
+
+    while (first < iov.size() && n >= iov[first].iov_len)
+      n -= iov[first++].iov_len;
+
+    if (n > 0)
+    {
+      iov[first].iov_base = static_cast<char*>(iov[first].iov_base) + n;
+      iov[first].iov_len -= n;
+    }
+  }
+}
+
+#endif // !_WIN32
+
+} // namespace details
+
+// Writes the elements or fields of a large root array or object on
+// several threads, each writing a chunk in its own buffer.
+// If threads is 0, the number of concurrent threads supported by the
+// hardware is used. The output is the same as stringify().
+inline std::string stringify_parallel(const json::Json& data, StringifyOptions options = None, unsigned int threads = 0)
+{
+  threads = details::parallel_threads(data, threads);
+
+  if (threads == 1)
+    return stringify(data, options);
+
+  std::vector<details::TextPart> parts = details::write_parallel(data, options, threads);
+
+  size_t size = 0;
+  for (const details::TextPart& p : parts)
+    size += p.size();
+
+  std::string result;
+  result.reserve(size);
+
+  for (const details::TextPart& p : parts)
+    result.append(p.data(), p.size());
+
+  return result;
+}
+
+#ifndef _WIN32
+
+// Same as stringify_parallel(), the chunks are written to the file
+// descriptor with writev() instead of being concatenated.
+inline void stringify_parallel_to_fd(int fd, const json::Json& data, StringifyOptions options = None, unsigned int threads = 0)
+{
+  threads = details::parallel_threads(data, threads);
+
+  if (threads == 1)
+    return stringify_to_fd(fd, data, options);
+
+  details::write_parts(fd, details::write_parallel(data, options, threads));
+}
+
+#endif // !_WIN32
+
+} // namespace json
+
+#endif // !JSONTOOLKIT_PARALLEL_STRINGIFY_H
@@ -7,10 +7,21 @@
 
 #include "json-toolkit/json.h"
 
+#include <cerrno>
+#include <clocale>
+#include <cmath>
+#include <cstdlib>
+#if defined(__APPLE__)
+#include <xlocale.h>
+#elif !defined(_WIN32)
+#include <locale.h>
+#endif // defined(__APPLE__)
+
 namespace json
 {
 
 json::Json parse(const std::string& str);
+json::Json parse(const std::string& str, StringPool& strings);
 
 enum class TokenType {
   Invalid = 0,
@@ -731,7 +742,10 @@ private:
 namespace json
 {
 
-inline json::Json parse(const std::string& str)
+namespace details
+{
+
+inline json::Json parse(const std::string& str, StringPool* strings)
 {
   Tokenizer<DefaultTokenizerBackend> tokenizer;
   auto& buffer = tokenizer.backend().token_buffer;
@@ -739,6 +753,7 @@ inline json::Json parse(const std::string& str)
   tokenizer.done();
 
   ParserMachine<DefaultParserBackend> parser;
+  parser.backend().strings = strings;
   
   for (const auto& tok : buffer)
   {
@@ -748,6 +763,18 @@ inline json::Json parse(const std::string& str)
   return parser.backend().stack.front();
 }
 
+} // namespace details
+
+inline json::Json parse(const std::string& str)
+{
+  return details::parse(str, nullptr);
+}
+
+inline json::Json parse(const std::string& str, StringPool& strings)
+{
+  return details::parse(str, &strings);
+}
+
 } // namespace json
 
 #endif // !JSONTOOLKIT_PARSING_H
\ No newline at end of file
@@ -0,0 +1,296 @@
+// Copyright (C) 2019 Vincent Chambrin
+// This file is part of the json-toolkit library
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#ifndef JSONTOOLKIT_PATCH_H
+#define JSONTOOLKIT_PATCH_H
+
+#include "json-toolkit/pointer.h"
+
+namespace json
+{
+
+/*!
+ * Patches are applied by modifying the containers that are referenced
+ * only by the patched Json, and by copying the ones that are shared
+ * with other Json. Therefore, other holders of the nodes of the document
+ * never see the modification, and untouched subtrees remain shared.
+ * Values inserted by a patch are shared with the patch document.
+ */
+
+void apply_patch(Json& doc, const Json& patch);
+Json patch(const Json& doc, const Json& patch);
+
+void apply_merge_patch(Json& target, const Json& patch);
+Json merge_patch(const Json& target, const Json& patch);
+
+namespace details
+{
+
+[[noreturn]] inline void patch_error(const std::string& op, const char* message)
+{
+  throw std::runtime_error{ "json::apply_patch() : " + op + " : " + message };
+}
+
+// Returns the value at the first count tokens of the pointer, owning
+// every container on the way to it.
+inline Json& patch_walk(Json& root, const Pointer& ptr, size_t count, const std::string& op)
+{
+  Json* current = &root;
+
+  for (size_t i(0); i < count; ++i)
+  {
+    const Pointer::Token& t = ptr.tokens()[i];
+
+    own(*current);
+
+    if (current->isObject())
+    {
+      auto* node = static_cast<ObjectNode*>(current->impl().get());
+
+      if (!node->find(t.key))
+        patch_error(op, "path not found");
+
+      current = &node->get(t.key);
+    }
+    else if (current->isArray())
+    {
+      auto* node = static_cast<ArrayNode*>(current->impl().get());
+
+      if (t.index < 0 || static_cast<size_t>(t.index) >= node->size())
+        patch_error(op, "path not found");
+
+      current = &node->elements()[t.index];
+    }
+    else
+    {
+      patch_error(op, "path not found");
+    }
+  }
+
+  return *current;
+}
+
+inline void patch_add(Json& root, const Pointer& path, Json value, const std::string& op)
+{
+  if (path.empty())
+  {
+    root = std::move(value);
+    return;
+  }
+
+  Json& parent = patch_walk(root, path, path.size() - 1, op);
+  const Pointer::Token& t = path.tokens().back();
+
+  own(parent);
+
+  if (parent.isObject())
+  {
+    static_cast<ObjectNode*>(parent.impl().get())->set(std::string(t.key.str()), std::move(value));
+  }
+  else if (parent.isArray())
+  {
+    auto* node = static_cast<ArrayNode*>(parent.impl().get());
+
+    if (t.isEnd())
+      node->push(std::move(value));
+    else if (t.index < 0 || static_cast<size_t>(t.index) > node->size())
+      patch_error(op, "invalid array index");
+    else
+    {
+      auto& elements = node->elements();
+      elements.insert(elements.begin() + t.index, std::move(value));
+    }
+  }
+  else
+  {
+    patch_error(op, "path not found");
+  }
+}
+
+inline Json patch_remove(Json& root, const Pointer& path, const std::string& op)
+{
+  if (path.empty())
+    patch_error(op, "cannot remove the root");
+
+  Json& parent = patch_walk(root, path, path.size() - 1, op);
+  const Pointer::Token& t = path.tokens().back();
+
+  own(parent);
+
+  if (parent.isObject())
+  {
+    auto& map = static_cast<ObjectNode*>(parent.impl().get())->map();
+    auto it = map.find(t.key.str());
+
+    if (it == map.end())
+      patch_error(op, "path not found");
+
+    Json result = std::move(it->second);
+    map.erase(it);
+    return result;
+  }
+  else if (parent.isArray())
+  {
+    auto* node = static_cast<ArrayNode*>(parent.impl().get());
+
+    if (t.index < 0 || static_cast<size_t>(t.index) >= node->size())
+      patch_error(op, "path not found");
+
+    auto& elements = node->elements();
+    Json result = std::move(elements[t.index]);
+    elements.erase(elements.begin() + t.index);
+    return result;
+  }
+
+  patch_error(op, "path not found");
+}
+
+inline Json patch_value(const Json& operation, const std::string& op)
+{
+  const Json* value = static_cast<const ObjectNode*>(operation.impl().get())->find("value", 5);
+
+  if (!value)
+    patch_error(op, "missing value");
+
+  return *value;
+}
+
+inline Pointer patch_pointer(const Json& operation, const char* name, const std::string& op)
+{
+  const Json* ptr = static_cast<const ObjectNode*>(operation.impl().get())->find(name, std::strlen(name));
+
+  if (!ptr || !ptr->isString())
+    patch_error(op, "missing pointer");
+
+  return Pointer(ptr->toString());
+}
+
+inline void apply_operation(Json& doc, const Json& operation)
+{
+  if (!operation.isObject() || !operation["op"].isString())
+    throw std::runtime_error{ "json::apply_patch() : invalid operation" };
+
+  const std::string op = operation["op"].toString();
+  const Pointer path = patch_pointer(operation, "path", op);
+
+  if (op == "add")
+  {
+    patch_add(doc, path, patch_value(operation, op), op);
+  }
+  else if (op == "remove")
+  {
+    patch_remove(doc, path, op);
+  }
+  else if (op == "replace")
+  {
+    Json& target = patch_walk(doc, path, path.size(), op);
+    target = patch_value(operation, op);
+  }
+  else if (op == "move")
+  {
+    const Pointer from = patch_pointer(operation, "from", op);
+
+    if (from.size() < path.size() && path.str().compare(0, from.str().size() + 1, from.str() + "/") == 0)
+      patch_error(op, "cannot move a value into one of its children");
+
+    if (from.str() == path.str())
+      return;
+
+    Json value = patch_remove(doc, from, op);
+    patch_add(doc, path, std::move(value), op);
+  }
+  else if (op == "copy")
+  {
+    const Pointer from = patch_pointer(operation, "from", op);
+    JsonView value;
+
+    if (!from.resolve(doc, value))
+      patch_error(op, "path not found");
+
+    patch_add(doc, path, value.toJson(), op);
+  }
+  else if (op == "test")
+  {
+    JsonView value;
+
+    if (!path.resolve(doc, value) || value != JsonView(patch_value(operation, op)))
+      patch_error(op, "test failed");
+  }
+  else
+  {
+    patch_error(op, "unknown operation");
+  }
+}
+
+} // namespace details
+
+// Applies a JSON Patch (RFC 6902).
+// If an operation fails, an exception is thrown and the operations
+// preceding it remain applied; use patch() for an all or nothing update.
+inline void apply_patch(Json& doc, const Json& patch)
+{
+  if (!patch.isArray())
+    throw std::runtime_error{ "json::apply_patch() : a patch must be an array" };
+
+  for (JsonView operation : JsonView(patch).elements())
+  {
+    if (!operation.json())
+      throw std::runtime_error{ "json::apply_patch() : invalid operation" };
+
+    details::apply_operation(doc, *operation.json());
+  }
+}
+
+// Returns the patched document, doc is left untouched.
+inline Json patch(const Json& doc, const Json& patch)
+{
+  Json result = doc;
+  apply_patch(result, patch);
+  return result;
+}
+
+// Applies a JSON Merge Patch (RFC 7386).
+inline void apply_merge_patch(Json& target, const Json& patch)
+{
+  if (!patch.isObject())
+  {
+    target = patch;
+    return;
+  }
+
+  if (!target.isObject())
+    target = Object();
+
+  details::own(target);
+  auto* node = static_cast<details::ObjectNode*>(target.impl().get());
+
+  for (auto it = JsonView(patch).fields().begin(); it != JsonView(patch).fields().end(); ++it)
+  {
+    if (it.value().isNull())
+    {
+      if (node->find(it.key()))
+        node->map().erase(it.key());
+    }
+    else if (it.value().isObject())
+    {
+      apply_merge_patch(node->get(it.key()), *it.value().json());
+    }
+    else
+    {
+      node->set(std::string(it.key()), it.value().toJson());
+    }
+  }
+}
+
+// Returns the merged document, target is left untouched.
+inline Json merge_patch(const Json& target, const Json& patch)
+{
+  Json result = target;
+  apply_merge_patch(result, patch);
+  return result;
+}
+
+} // namespace json
+
+#endif // !JSONTOOLKIT_PATCH_H
@@ -0,0 +1,357 @@
+// Copyright (C) 2019 Vincent Chambrin
+// This file is part of the json-toolkit library
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#ifndef JSONTOOLKIT_POINTER_H
+#define JSONTOOLKIT_POINTER_H
+
+#include "json-toolkit/json.h"
+
+#include <climits>
+
+namespace json
+{
+
+/*!
+ * \class Pointer
+ * \brief a JSON Pointer (RFC 6901)
+ *
+ * The pointer is parsed once: each reference token is stored as a Key
+ * and, if it is a valid array index, as an integer.
+ *
+ * \code
+ * static const Pointer port{ "/server/listen/0/port" };
+ * int p = port(JsonView(config)).toInt();
+ * \endcode
+ */
+class Pointer
+{
+public:
+  struct Token
+  {
+    Key key;
+    // -1 if the token is not an array index
+    int index;
+
+    explicit Token(std::string str);
+
+    // "-" refers to the element after the last element of an array
+    inline bool isEnd() const { return key.str() == "-"; }
+  };
+
+public:
+  Pointer() = default;
+  Pointer(const Pointer&) = default;
+  Pointer(Pointer&&) = default;
+  ~Pointer() = default;
+
+  explicit Pointer(const std::string& str);
+
+  inline const std::vector<Token>& tokens() const { return m_tokens; }
+  inline size_t size() const { return m_tokens.size(); }
+  inline bool empty() const { return m_tokens.empty(); }
+
+  Pointer parent() const;
+  Pointer& push(std::string token);
+
+  std::string str() const;
+
+  bool resolve(const JsonView& root, JsonView& result) const;
+  JsonView operator()(const JsonView& root) const;
+
+  Pointer& operator=(const Pointer&) = default;
+  Pointer& operator=(Pointer&&) = default;
+
+private:
+  std::vector<Token> m_tokens;
+};
+
+/*!
+ * \class PointerSet
+ * \brief evaluates several pointers in a single traversal
+ *
+ * Pointers are organized in a tree of their reference tokens so that
+ * common prefixes are only resolved once.
+ */
+class PointerSet
+{
+public:
+  PointerSet();
+  PointerSet(const PointerSet&) = default;
+  ~PointerSet() = default;
+
+  explicit PointerSet(const std::vector<Pointer>& pointers);
+
+  size_t add(const Pointer& ptr);
+  inline size_t size() const { return m_size; }
+
+  // Resolves every pointer, in the order they were added.
+  // Pointers that do not resolve give a null view.
+  std::vector<JsonView> evaluate(const JsonView& root) const;
+  void evaluate(const JsonView& root, std::vector<JsonView>& results) const;
+
+  PointerSet& operator=(const PointerSet&) = default;
+
+protected:
+  void evaluate(size_t node, const JsonView& value, std::vector<JsonView>& results) const;
+
+private:
+  struct Node
+  {
+    Pointer::Token token;
+    std::vector<size_t> children;
+    // indices of the pointers ending at this node
+    std::vector<size_t> targets;
+  };
+
+  std::vector<Node> m_nodes;
+  size_t m_size = 0;
+};
+
+namespace details
+{
+
+inline std::string unescape_pointer_token(const std::string& str)
+{
+  std::string result;
+  result.reserve(str.size());
+
+  for (size_t i(0); i < str.size(); ++i)
+  {
+    if (str[i] != '~')
+    {
+      result.push_back(str[i]);
+    }
+    else if (i + 1 < str.size() && (str[i + 1] == '0' || str[i + 1] == '1'))
+    {
+      result.push_back(str[i + 1] == '0' ? '~' : '/');
+      ++i;
+    }
+    else
+    {
+      throw std::runtime_error{ "json::Pointer : invalid escape sequence" };
+    }
+  }
+
+  return result;
+}
+
+// Appends "/token" to the pointer representation, escaping the token.
+inline void append_pointer_token(std::string& ptr, const std::string& token)
+{
+  ptr.push_back('/');
+
+  for (char c : token)
+  {
+    if (c == '~')
+      ptr += "~0";
+    else if (c == '/')
+      ptr += "~1";
+    else
+      ptr.push_back(c);
+  }
+}
+
+inline int pointer_index(const std::string& str)
+{
+  if (str.empty() || (str.size() > 1 && str.front() == '0'))
+    return -1;
+
+  long long result = 0;
+
+  for (char c : str)
+  {
+    if (c < '0' || c > '9')
+      return -1;
+
+    result = result * 10 + (c - '0');
+
+    if (result > INT_MAX)
+      return -1;
+  }
+
+  return static_cast<int>(result);
+}
+
+// Resolves a single reference token, returns false if the value has
+// no such member or element.
+inline bool pointer_step(const JsonView& value, const Pointer::Token& token, JsonView& result)
+{
+  if (value.isObject())
+  {
+    const Json* member = static_cast<const ObjectNode*>(value.json()->impl().get())->find(token.key);
+
+    if (!member)
+      return false;
+
+    result = JsonView(*member);
+    return true;
+  }
+  else if (value.isArray())
+  {
+    if (token.index < 0 || token.index >= value.length())
+      return false;
+
+    result = value.at(token.index);
+    return true;
+  }
+
+  return false;
+}
+
+} // namespace details
+
+inline Pointer::Token::Token(std::string str)
+  : key(std::move(str)),
+    index(details::pointer_index(key.str()))
+{
+
+}
+
+inline Pointer::Pointer(const std::string& str)
+{
+  if (str.empty())
+    return;
+
+  if (str.front() != '/')
+    throw std::runtime_error{ "json::Pointer : a pointer must start with '/'" };
+
+  size_t start = 1;
+
+  for (;;)
+  {
+    const size_t end = str.find('/', start);
+    m_tokens.emplace_back(details::unescape_pointer_token(str.substr(start, end == std::string::npos ? std::string::npos : end - start)));
+
+    if (end == std::string::npos)
+      break;
+
+    start = end + 1;
+  }
+}
+
+inline Pointer Pointer::parent() const
+{
+  Pointer result;
+
+  if (!m_tokens.empty())
+    result.m_tokens.assign(m_tokens.begin(), m_tokens.end() - 1);
+
+  return result;
+}
+
+inline Pointer& Pointer::push(std::string token)
+{
+  m_tokens.emplace_back(std::move(token));
+  return *this;
+}
+
+inline std::string Pointer::str() const
+{
+  std::string result;
+
+  for (const Token& t : m_tokens)
+    details::append_pointer_token(result, t.key.str());
+
+  return result;
+}
+
+inline bool Pointer::resolve(const JsonView& root, JsonView& result) const
+{
+  JsonView current = root;
+
+  for (const Token& t : m_tokens)
+  {
+    if (!details::pointer_step(current, t, current))
+      return false;
+  }
+
+  result = current;
+  return true;
+}
+
+// Returns the value the pointer refers to, or a null view if there is none.
+inline JsonView Pointer::operator()(const JsonView& root) const
+{
+  JsonView result;
+  resolve(root, result);
+  return result;
+}
+
+inline PointerSet::PointerSet()
+{
+  // the root node, its token is never used
+  m_nodes.push_back(Node{ Pointer::Token(""), {}, {} });
+}
+
+inline PointerSet::PointerSet(const std::vector<Pointer>& pointers)
+  : PointerSet()
+{
+  for (const Pointer& p : pointers)
+    add(p);
+}
+
+// Adds a pointer to the set and returns its index in the results.
+inline size_t PointerSet::add(const Pointer& ptr)
+{
+  size_t node = 0;
+
+  for (const Pointer::Token& t : ptr.tokens())
+  {
+    size_t next = 0;
+
+    for (size_t child : m_nodes[node].children)
+    {
+      if (m_nodes[child].token.key.str() == t.key.str())
+      {
+        next = child;
+        break;
+      }
+    }
+
+    if (next == 0)
+    {
+      next = m_nodes.size();
+      m_nodes.push_back(Node{ t, {}, {} });
+      m_nodes[node].children.push_back(next);
+    }
+
+    node = next;
+  }
+
+  m_nodes[node].targets.push_back(m_size);
+  return m_size++;
+}
+
+inline std::vector<JsonView> PointerSet::evaluate(const JsonView& root) const
+{
+  std::vector<JsonView> results;
+  evaluate(root, results);
+  return results;
+}
+
+inline void PointerSet::evaluate(const JsonView& root, std::vector<JsonView>& results) const
+{
+  results.assign(m_size, JsonView());
+  evaluate(0, root, results);
+}
+
+inline void PointerSet::evaluate(size_t node, const JsonView& value, std::vector<JsonView>& results) const
+{
+  const Node& n = m_nodes[node];
+
+  for (size_t t : n.targets)
+    results[t] = value;
+
+  for (size_t child : n.children)
+  {
+    JsonView child_value;
+
+    if (details::pointer_step(value, m_nodes[child].token, child_value))
+      evaluate(child, child_value, results);
+  }
+}
+
+} // namespace json
+
+#endif // !JSONTOOLKIT_POINTER_H
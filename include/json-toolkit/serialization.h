@@ -9,6 +9,8 @@
 
 #include <unordered_map>
 #include <stdexcept>
+#include <type_traits>
+#include <utility>
 
 #if __cplusplus >= 201703L || defined(JSONTOOLKIT_CXX17)
 #include <optional>
@@ -28,7 +30,7 @@ namespace serialization
 template<typename T>
 struct decoder
 {
-  static void decode(Serializer&, const Json&, T&)
+  static void decode(Serializer&, const JsonView&, T&)
   {
     throw std::runtime_error{ "No decoder" };
   }
@@ -55,7 +57,7 @@ public:
   ~Serializer() = default;
 
   template<typename T>
-  T decode(const Json& obj);
+  T decode(const JsonView& data);
 
   template<typename T>
   Json encode(const T& value);
@@ -77,7 +79,7 @@ public:
 
   virtual hash_code_t hash_code() const = 0;
 
-  virtual void decode(Serializer& serializer, const Json& data, void* value) = 0;
+  virtual void decode(Serializer& serializer, const JsonView& data, void* value) = 0;
   virtual Json encode(Serializer& serializer, void* value) = 0;
 };
 
@@ -87,7 +89,7 @@ namespace serialization
 template<>
 struct decoder<bool>
 {
-  static void decode(Serializer& s, const Json& data, bool& value)
+  static void decode(Serializer& s, const JsonView& data, bool& value)
   {
     value = data.toBool();
   }
@@ -96,7 +98,7 @@ struct decoder<bool>
 template<>
 struct decoder<int>
 {
-  static void decode(Serializer& s, const Json& data, int& value)
+  static void decode(Serializer& s, const JsonView& data, int& value)
   {
     value = data.toInt();
   }
@@ -105,7 +107,7 @@ struct decoder<int>
 template<>
 struct decoder<std::string>
 {
-  static void decode(Serializer& s, const Json& data, std::string& value)
+  static void decode(Serializer& s, const JsonView& data, std::string& value)
   {
     value = data.toString();
   }
@@ -114,7 +116,7 @@ struct decoder<std::string>
 template<>
 struct decoder<double>
 {
-  static void decode(Serializer& s, const Json& data, double& value)
+  static void decode(Serializer& s, const JsonView& data, double& value)
   {
     value = data.toNumber();
   }
@@ -123,13 +125,15 @@ struct decoder<double>
 template<typename T>
 struct decoder<std::vector<T>>
 {
-  static void decode(Serializer& s, const Json& data, std::vector<T>& value)
+  static void decode(Serializer& s, const JsonView& data, std::vector<T>& value)
   {
     if (!data.isArray())
       throw std::runtime_error{ "Serializer::decode() : decode error - not an array" };
 
-    for (int i(0); i < data.length(); ++i)
-      value.push_back(s.decode<T>(data.at(i)));
+    value.reserve(value.size() + data.size());
+
+    for (JsonView e : data.elements())
+      value.push_back(s.decode<T>(e));
   }
 };
 
@@ -196,7 +200,7 @@ struct variant_decoder;
 template<typename...Args, size_t Index>
 struct variant_decoder<std::variant<Args...>, Index>
 {
-  static void decode(Serializer& s, size_t index, const Json& data, std::variant<Args...>& value)
+  static void decode(Serializer& s, size_t index, const JsonView& data, std::variant<Args...>& value)
   {
     if constexpr (Index == sizeof...(Args))
     {
@@ -217,7 +221,7 @@ struct variant_decoder<std::variant<Args...>, Index>
 template<typename...Args>
 struct decoder<std::variant<Args...>>
 {
-  static void decode(Serializer& s, const Json& data, std::variant<Args...>& value)
+  static void decode(Serializer& s, const JsonView& data, std::variant<Args...>& value)
   {
     variant_decoder<std::variant<Args...>, 0>::decode(s, data["index"].toInt(), data["value"], value);
   }
@@ -249,7 +253,7 @@ namespace serialization
 template<typename T>
 struct decoder<std::optional<T>>
 {
-  static void decode(Serializer& s, const Json& data, std::optional<T>& value)
+  static void decode(Serializer& s, const JsonView& data, std::optional<T>& value)
   {
     if (data.isNull())
       return;
@@ -279,8 +283,44 @@ struct encoder<std::optional<T>>
 namespace json
 {
 
+namespace details
+{
+
+// Tells whether decoder<T>::decode() takes a JsonView or, like decoders
+// written before JsonView, a const Json&.
+template<typename T>
+class decodes_views
+{
+  template<typename U>
+  static auto test(int) -> decltype(serialization::decoder<U>::decode(std::declval<Serializer&>(), std::declval<const JsonView&>(), std::declval<U&>()), std::true_type());
+
+  template<typename U>
+  static std::false_type test(...);
+
+public:
+  static const bool value = decltype(test<T>(0))::value;
+};
+
+template<typename T>
+inline void decode(Serializer& s, const JsonView& data, T& value, std::true_type)
+{
+  serialization::decoder<T>::decode(s, data, value);
+}
+
+// Null views and elements of packed arrays have no Json, one is created.
+template<typename T>
+inline void decode(Serializer& s, const JsonView& data, T& value, std::false_type)
+{
+  if (data.json())
+    serialization::decoder<T>::decode(s, *data.json(), value);
+  else
+    serialization::decoder<T>::decode(s, data.toJson(), value);
+}
+
+} // namespace details
+
 template<typename T>
-inline T Serializer::decode(const Json& obj)
+inline T Serializer::decode(const JsonView& data)
 {
   T result;
   
@@ -288,11 +328,11 @@ inline T Serializer::decode(const Json& obj)
 
   if (it != codecs().end())
   {
-    it->second->decode(*this, obj, (void*)& result);
+    it->second->decode(*this, data, (void*)& result);
     return result;
   }
 
-  serialization::decoder<T>::decode(*this, obj, result);
+  details::decode(*this, data, result, std::integral_constant<bool, details::decodes_views<T>::value>());
 
   return result;
 }
@@ -327,7 +367,7 @@ public:
   ObjectField(const std::string& mn) : member_name_(mn), optional_(false) { }
   virtual ~ObjectField() = default;
 
-  virtual void decode_field(Serializer& serializer, const Json& object_data, const Json& field_data, void* value) = 0;
+  virtual void decode_field(Serializer& serializer, const JsonView& object_data, const JsonView& field_data, void* value) = 0;
   virtual Json encode_field(Serializer& serializer, void* value) = 0;
 
   std::string member_name_;
@@ -344,7 +384,7 @@ public:
   SimpleMemberField(const std::string& mn, M T::*mem_ptr) : ObjectField(mn), member(mem_ptr) { }
   ~SimpleMemberField() = default;
 
-  void decode_field(Serializer& serializer, const Json& object_data, const Json& field_data, void* value) override
+  void decode_field(Serializer& serializer, const JsonView& object_data, const JsonView& field_data, void* value) override
   {
     T& object = *static_cast<T*>(value);
     object.*member = serializer.decode<M>(field_data);
@@ -368,7 +408,7 @@ public:
   MemberField(const std::string& mn, Getter get, Setter set) : ObjectField(mn), getter(get), setter(set) { }
   ~MemberField() = default;
 
-  void decode_field(Serializer& serializer, const Json& object_data, const Json& field_data, void* value) override
+  void decode_field(Serializer& serializer, const JsonView& object_data, const JsonView& field_data, void* value) override
   {
     T& object = *static_cast<T*>(value);
     (object.*setter)(serializer.decode<M>(field_data));
@@ -408,7 +448,7 @@ public:
 
   hash_code_t hash_code() const override { return typeid(T).hash_code(); }
 
-  void decode(Serializer& serializer, const Json& data, void* value) override
+  void decode(Serializer& serializer, const JsonView& data, void* value) override
   {
     T& object = *static_cast<T*>(value);
 
@@ -416,7 +456,7 @@ public:
     {
       details::ObjectField* field = it->second.get();
 
-      Json field_data = data[field->member_name_];
+      JsonView field_data = data[field->member_name_];
 
       if (field_data.isNull())
       {
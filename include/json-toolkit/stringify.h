@@ -12,9 +12,30 @@ namespace json
 
 enum StringifyOptions {
   None = 0,
+  // non-ASCII characters are written as \uXXXX escape sequences
+  AsciiOnly = 1,
+  // no whitespace, see CompactFormat
+  Compact = 2,
+  // computes the size of the output first to allocate it once, see stringify()
+  Presize = 4,
+  // reuses and records the serialized text of containers, see stringify()
+  CacheFragments = 8,
 };
 
+inline StringifyOptions operator|(StringifyOptions lhs, StringifyOptions rhs)
+{
+  return static_cast<StringifyOptions>(static_cast<int>(lhs) | static_cast<int>(rhs));
+}
+
+class CompactFormat;
+class PrettyFormat;
+
 std::string stringify(const json::Json& data, StringifyOptions options = None);
+std::string stringify(const json::Json& data, const PrettyFormat& format, StringifyOptions options = None);
+
+size_t serialized_size(const json::Json& data, StringifyOptions options = None);
+size_t serialized_size(const json::Json& data, const PrettyFormat& format, StringifyOptions options = None);
+size_t stringify_to(char* buffer, size_t size, const json::Json& data, StringifyOptions options = None);
 
 enum class WriterState
 {
@@ -26,13 +47,131 @@ enum class WriterState
   WroteArrayValue,
 };
 
-template<typename Backend>
+/*!
+ * \class CompactFormat
+ * \brief format policy of the GenericWriter writing no whitespace
+ */
+class CompactFormat
+{
+public:
+  // identifies the layout of a container written at the given depth
+  inline int fragment_format() const { return -1; }
+  inline size_t fragment_depth(size_t /* depth */) const { return 0; }
+
+  template<typename Backend>
+  void member(Backend& backend, bool first, size_t /* depth */)
+  {
+    if (!first)
+      backend << CharCategory::Comma;
+  }
+
+  template<typename Backend>
+  void key_separator(Backend& backend)
+  {
+    backend << CharCategory::Colon;
+  }
+
+  template<typename Backend>
+  void end_members(Backend& /* backend */, size_t /* depth */)
+  {
+
+  }
+
+  template<typename Backend>
+  void element_separator(Backend& backend)
+  {
+    backend << CharCategory::Comma;
+  }
+};
+
+/*!
+ * \class PrettyFormat
+ * \brief format policy of the GenericWriter writing one member per line
+ *
+ * Members of objects are indented by width spaces per level, elements
+ * of arrays are written on a single line.
+ * The backend must provide append(const char*, size_t), which receives
+ * the new line and its indentation at once.
+ */
+class PrettyFormat
+{
+public:
+  explicit PrettyFormat(int width = 2)
+    : m_width(static_cast<size_t>(width))
+  {
+    m_newline.assign(1 + 8 * m_width, ' ');
+    m_newline[0] = '\n';
+  }
+
+  inline int width() const { return static_cast<int>(m_width); }
+
+  inline int fragment_format() const { return width(); }
+  inline size_t fragment_depth(size_t depth) const { return depth; }
+
+  template<typename Backend>
+  void member(Backend& backend, bool first, size_t depth)
+  {
+    if (!first)
+      backend << CharCategory::Comma;
+
+    newline(backend, depth);
+  }
+
+  template<typename Backend>
+  void key_separator(Backend& backend)
+  {
+    backend << CharCategory::Colon << CharCategory::Space;
+  }
+
+  template<typename Backend>
+  void end_members(Backend& backend, size_t depth)
+  {
+    newline(backend, depth - 1);
+  }
+
+  template<typename Backend>
+  void element_separator(Backend& backend)
+  {
+    backend << CharCategory::Comma << CharCategory::Space;
+  }
+
+protected:
+  template<typename Backend>
+  void newline(Backend& backend, size_t depth)
+  {
+    const size_t length = 1 + depth * m_width;
+
+    if (m_newline.size() < length)
+      m_newline.resize(2 * length, ' ');
+
+    backend.append(m_newline.data(), length);
+  }
+
+private:
+  size_t m_width;
+  // a new line followed by spaces
+  std::string m_newline;
+};
+
+template<typename Backend, typename Format = PrettyFormat>
 class GenericWriter
 {
 public:
-  GenericWriter()
+  explicit GenericWriter(Format format = Format())
     : m_key_quotes(CharCategory::Invalid), 
-    m_depth(0)
+    m_depth(0),
+    m_format(std::move(format))
+  {
+    m_states.push_back(WriterState::Idle);
+  }
+
+  // The arguments after the format are forwarded to the constructor of the backend.
+  template<typename Arg, typename...Args>
+  GenericWriter(Format format, Arg&& arg, Args&&... args)
+    : m_key_quotes(CharCategory::Invalid),
+    m_depth(0),
+    m_format(std::move(format)),
+    m_backend(std::forward<Arg>(arg), std::forward<Args>(args)...)
   {
     m_states.push_back(WriterState::Idle);
   }
@@ -77,6 +216,24 @@ public:
     update();
   }
 
+  // Writes a value that is already formatted.
+  void raw_value(const char* text, size_t length)
+  {
+    writeArraySeparator();
+    backend().append(text, length);
+    update();
+  }
+
+  // Continues the current container as if a value had been written,
+  // used when its first values were written by another writer.
+  void resume()
+  {
+    if (state() == WriterState::StartedArray)
+      update(WriterState::WroteArrayValue);
+    else if (state() == WriterState::StartedObject)
+      update(WriterState::WroteObjectValue);
+  }
+
   void start_object()
   {
     writeArraySeparator();
@@ -90,20 +247,19 @@ public:
   {
     if (state() == WriterState::WroteObjectValue)
     {
-      backend() << CharCategory::Comma << CharCategory::NewLine;
+      m_format.member(backend(), false, depth());
     }
     else if (state() == WriterState::StartedObject)
     {
-      backend() << CharCategory::NewLine;
+      m_format.member(backend(), true, depth());
     }
     else
     {
       throw std::runtime_error{ "Invalid writer state" };
     }
 
-    indent();
-
-    backend() << CharCategory::DoubleQuote <<  str << CharCategory::DoubleQuote  << CharCategory::Colon << CharCategory::Space;
+    backend() << CharCategory::DoubleQuote <<  str << CharCategory::DoubleQuote;
+    m_format.key_separator(backend());
 
     update(WriterState::WroteObjectKey);
   }
@@ -116,8 +272,7 @@ public:
     }
     else if (state() == WriterState::WroteObjectValue)
     {
-      backend() << CharCategory::NewLine;
-      indent(-1);
+      m_format.end_members(backend(), depth());
       backend() << CharCategory::RBrace;
     }
 
@@ -169,13 +324,8 @@ protected:
       update(WriterState::WroteArrayValue);
   }
 
-  void indent(int delta = 0)
-  {
-    for (size_t i(0); i < stack().size() - 1 + delta; ++i)
-    {
-      backend() << CharCategory::Space << CharCategory::Space;
-    }
-  }
+  // nesting level of the current container
+  inline size_t depth() const { return m_states.size() - 1; }
 
   // Update state after writing a value
   void update()
@@ -190,13 +340,14 @@ protected:
   {
     if (state() == WriterState::WroteArrayValue)
     {
-      backend() << CharCategory::Comma << CharCategory::Space;
+      m_format.element_separator(backend());
     }
   }
 
 private:
   CharCategory m_key_quotes;
   int m_depth;
+  Format m_format;
   Backend m_backend;
   std::vector<WriterState> m_states;
 };
@@ -204,6 +355,7 @@ private:
 } // namespace json
 
 #include "json-default-writer-backend.h"
+#include "json-stream-writer-backend.h"
 
 namespace json
 {
@@ -211,63 +363,428 @@ namespace json
 namespace details
 {
 
-inline void write(GenericWriter<DefaultWriterBackend>& writer, const json::Json& data)
+template<typename Iterator>
+struct WriteCursor
+{
+  Iterator current;
+  Iterator end;
+};
+
+struct NoFragments
+{
+  template<typename Writer>
+  bool splice(Writer& /* writer */, const JsonView& /* value */, size_t /* depth */) { return false; }
+
+  template<typename Writer>
+  void enter(Writer& /* writer */, const JsonView& /* value */, size_t /* depth */) { }
+
+  template<typename Writer>
+  void leave(Writer& /* writer */) { }
+};
+
+/*!
+ * \class FragmentCache
+ * \brief splices the serialized text memoized by containers
+ *
+ * Only frozen containers are considered: a container that is not frozen
+ * can be modified through a Json referring to one of its children, which
+ * would leave a stale text in it.
+ */
+template<typename Format>
+class FragmentCache : public NoFragments
 {
-  if (data.isArray())
+public:
+  FragmentCache(const Format& format, bool ascii_only)
+    : m_format(format), m_ascii_only(ascii_only)
   {
-    writer.start_array();
 
-    for (int i(0); i < data.length(); ++i)
+  }
+
+  template<typename Writer>
+  bool splice(Writer& writer, const JsonView& value, size_t depth)
+  {
+    const ContainerNode* node = frozen_container(value);
+
+    if (!node || !node->has_fragment.load(std::memory_order_acquire))
+      return false;
+
+    std::shared_ptr<const Fragment> fragment = std::atomic_load(&node->fragment_cache);
+
+    if (!fragment || !fragment->matches(m_format.fragment_format(), m_format.fragment_depth(depth), m_ascii_only))
+      return false;
+
+    writer.raw_value(fragment->text.data(), fragment->text.size());
+    return true;
+  }
+
+protected:
+  // Returns the node of a frozen container, nullptr otherwise.
+  // Immortal nodes are shared by every thread and never written to.
+  static const ContainerNode* frozen_container(const JsonView& value)
+  {
+    auto* node = static_cast<const ContainerNode*>(value.json()->impl().get());
+    return node->frozen && value.json()->impl().use_count() != 0 ? node : nullptr;
+  }
+
+protected:
+  const Format& m_format;
+  bool m_ascii_only;
+};
+
+/*!
+ * \class FragmentRecorder
+ * \brief splices and records the serialized text of containers
+ *
+ * The text of the frozen containers that were written is stored in them,
+ * which requires a backend providing str().
+ * So that the memory used does not grow with the depth of the document,
+ * the recorded texts do not overlap: only the outermost containers whose
+ * text is between min_size and max_size bytes long are recorded.
+ */
+template<typename Format>
+class FragmentRecorder : public FragmentCache<Format>
+{
+public:
+  static const size_t min_size = 32;
+  static const size_t max_size = 4096;
+
+  FragmentRecorder(const Format& format, bool ascii_only)
+    : FragmentCache<Format>(format, ascii_only)
+  {
+
+  }
+
+  // Called after the opening bracket of the container was written.
+  template<typename Writer>
+  void enter(Writer& writer, const JsonView& value, size_t depth)
+  {
+    m_open.push_back(Open{ this->frozen_container(value), writer.backend().size() - 1, depth, m_candidates.size() });
+  }
+
+  template<typename Writer>
+  void leave(Writer& writer)
+  {
+    const Open open = m_open.back();
+    m_open.pop_back();
+
+    const size_t length = writer.backend().size() - open.start;
+
+    if (length > max_size)
+    {
+      // the candidates found in the container are the outermost ones
+      record(writer, open.candidates);
+    }
+    else if (open.node != nullptr && length >= min_size)
     {
-      write(writer, data.at(i));
+      // the container encloses the candidates found in it
+      m_candidates.resize(open.candidates);
+      m_candidates.push_back(Candidate{ open.node, open.start, length, open.depth });
     }
 
-    writer.end_array();
+    if (m_open.empty())
+      record(writer, 0);
   }
-  else if (data.isObject())
+
+protected:
+  // Stores the text of the candidates from first in their node.
+  template<typename Writer>
+  void record(Writer& writer, size_t first)
   {
-    writer.start_object();
+    for (size_t i(first); i < m_candidates.size(); ++i)
+    {
+      const Candidate& c = m_candidates[i];
 
-    Object obj = data.toObject();
+      auto fragment = std::make_shared<Fragment>();
+      fragment->format = this->m_format.fragment_format();
+      fragment->depth = this->m_format.fragment_depth(c.depth);
+      fragment->ascii_only = this->m_ascii_only;
+      fragment->text.assign(writer.backend().str(), c.start, c.length);
 
-    for (const auto& e : obj.data())
-    {
-      writer.key(e.first);
-      write(writer, e.second);
+      std::atomic_store(&c.node->fragment_cache, std::shared_ptr<const Fragment>(std::move(fragment)));
+      c.node->has_fragment.store(true, std::memory_order_release);
     }
 
-    writer.end_object();
+    m_candidates.resize(first);
   }
-  else if (data.isNull())
+
+private:
+  struct Open
   {
-    writer.value(nullptr);
+    // nullptr if the container cannot be recorded
+    const ContainerNode* node;
+    size_t start;
+    size_t depth;
+    // index of the first candidate found in the container
+    size_t candidates;
+  };
+
+  struct Candidate
+  {
+    const ContainerNode* node;
+    size_t start;
+    size_t length;
+    size_t depth;
+  };
+
+  std::vector<Open> m_open;
+  std::vector<Candidate> m_candidates;
+};
+
+template<typename Format>
+const size_t FragmentRecorder<Format>::min_size;
+
+template<typename Format>
+const size_t FragmentRecorder<Format>::max_size;
+
+// Writes the value without recursion, so that documents of any depth can
+// be written. Containers being written are kept on explicit stacks and
+// their children are only borrowed, through views.
+// base_depth is the depth of the value in the document being written,
+// which is not 0 when the writer already opened its parent containers.
+template<typename Writer, typename Fragments>
+void write(Writer& writer, const JsonView& data, Fragments& fragments, size_t base_depth = 0)
+{
+  typedef WriteCursor<JsonView::ElementIterator> ArrayCursor;
+  typedef WriteCursor<JsonView::FieldIterator> ObjectCursor;
+
+  std::vector<JsonType> containers;
+  std::vector<ArrayCursor> arrays;
+  std::vector<ObjectCursor> objects;
+
+  JsonView value = data;
+
+  for (;;)
+  {
+    switch (value.type())
+    {
+    case JsonType::Array:
+    {
+      if (fragments.splice(writer, value, base_depth + containers.size()))
+        break;
+
+      auto elements = value.elements();
+      writer.start_array();
+      fragments.enter(writer, value, base_depth + containers.size());
+      containers.push_back(JsonType::Array);
+      arrays.push_back(ArrayCursor{ elements.begin(), elements.end() });
+      break;
+    }
+    case JsonType::Object:
+    {
+      if (fragments.splice(writer, value, base_depth + containers.size()))
+        break;
+
+      auto fields = value.fields();
+      writer.start_object();
+      fragments.enter(writer, value, base_depth + containers.size());
+      containers.push_back(JsonType::Object);
+      objects.push_back(ObjectCursor{ fields.begin(), fields.end() });
+      break;
+    }
+    case JsonType::Null:
+      writer.value(nullptr);
+      break;
+    case JsonType::Boolean:
+      writer.value(value.toBool());
+      break;
+    case JsonType::Integer:
+      writer.value(value.toInt());
+      break;
+    case JsonType::Number:
+      writer.value(value.toNumber());
+      break;
+    case JsonType::String:
+      writer.value(value.toString());
+      break;
+    }
+
+    // moves to the next value, closing the containers that are complete
+    for (;;)
+    {
+      if (containers.empty())
+        return;
+
+      if (containers.back() == JsonType::Array)
+      {
+        ArrayCursor& cursor = arrays.back();
+
+        if (cursor.current != cursor.end)
+        {
+          value = *cursor.current;
+          ++cursor.current;
+          break;
+        }
+
+        writer.end_array();
+        fragments.leave(writer);
+        arrays.pop_back();
+      }
+      else
+      {
+        ObjectCursor& cursor = objects.back();
+
+        if (cursor.current != cursor.end)
+        {
+          writer.key(cursor.current.key());
+          value = cursor.current.value();
+          ++cursor.current;
+          break;
+        }
+
+        writer.end_object();
+        fragments.leave(writer);
+        objects.pop_back();
+      }
+
+      containers.pop_back();
+    }
   }
-  else if (data.isBoolean())
+}
+
+template<typename Writer>
+void write(Writer& writer, const JsonView& data)
+{
+  NoFragments fragments;
+  write(writer, data, fragments);
+}
+
+// Cached fragments are spliced but not recorded, see FragmentRecorder.
+template<typename Writer, typename Format>
+void write(Writer& writer, const JsonView& data, const Format& format, StringifyOptions options)
+{
+  writer.backend().ascii_only = (options & AsciiOnly) != 0;
+
+  if (options & CacheFragments)
   {
-    writer.value(data.toBool());
+    FragmentCache<Format> fragments{ format, writer.backend().ascii_only };
+    write(writer, data, fragments);
   }
-  else if (data.isInteger())
+  else
   {
-    writer.value(data.toInt());
+    write(writer, data);
   }
-  else if (data.isNumber())
+}
+
+template<typename Format>
+size_t serialized_size(const JsonView& data, const Format& format, StringifyOptions options)
+{
+  GenericWriter<CountingWriterBackend, Format> writer{ format };
+  write(writer, data, format, options);
+  return writer.backend().size();
+}
+
+template<typename Format>
+std::string stringify(const JsonView& data, const Format& format, StringifyOptions options)
+{
+  GenericWriter<DefaultWriterBackend, Format> writer{ format };
+
+  if (options & Presize)
+    writer.backend().reserve(serialized_size(data, format, options));
+
+  if (options & CacheFragments)
   {
-    writer.value(data.toNumber());
+    writer.backend().ascii_only = (options & AsciiOnly) != 0;
+    FragmentRecorder<Format> fragments{ format, writer.backend().ascii_only };
+    write(writer, data, fragments);
   }
-  else if (data.isString())
+  else
   {
-    writer.value(data.toString());
+    write(writer, data, format, options);
   }
+
+  return writer.backend().result();
+}
+
+template<typename Sink, typename Format>
+void stringify_to(Sink sink, const JsonView& data, const Format& format, StringifyOptions options)
+{
+  GenericWriter<BufferedWriterBackend<Sink>, Format> writer{ format, std::move(sink) };
+  write(writer, data, format, options);
+  writer.backend().flush();
+}
+
+template<typename Sink>
+void stringify_to(Sink sink, const JsonView& data, StringifyOptions options)
+{
+  if (options & Compact)
+    stringify_to(std::move(sink), data, CompactFormat(), options);
+  else
+    stringify_to(std::move(sink), data, PrettyFormat(), options);
 }
 
 } // namespace details
 
+// With Presize, the exact size of the output is computed first so that it
+// is allocated once, at the cost of formatting the document twice.
+// With CacheFragments, the text of the frozen containers is stored in
+// them and reused by the next calls, see FragmentRecorder. Containers
+// that are not frozen are always written.
 inline std::string stringify(const json::Json& data, StringifyOptions options)
 {
-  GenericWriter<DefaultWriterBackend> writer;
-  details::write(writer, data);
-  return writer.backend().result();
+  if (options & Compact)
+    return details::stringify(data, CompactFormat(), options);
+  else
+    return details::stringify(data, PrettyFormat(), options);
+}
+
+// Pretty output with a custom indentation.
+inline std::string stringify(const json::Json& data, const PrettyFormat& format, StringifyOptions options)
+{
+  return details::stringify(data, format, options);
+}
+
+// Returns the length of the text stringify() would produce.
+inline size_t serialized_size(const json::Json& data, StringifyOptions options)
+{
+  if (options & Compact)
+    return details::serialized_size(data, CompactFormat(), options);
+  else
+    return details::serialized_size(data, PrettyFormat(), options);
+}
+
+inline size_t serialized_size(const json::Json& data, const PrettyFormat& format, StringifyOptions options)
+{
+  return details::serialized_size(data, format, options);
+}
+
+// Writes into a buffer of the given size, without a null terminator,
+// and returns the number of bytes written. Throws if the buffer is too
+// small, serialized_size() gives the size needed.
+inline size_t stringify_to(char* buffer, size_t size, const json::Json& data, StringifyOptions options)
+{
+  if (options & Compact)
+  {
+    GenericWriter<FixedBufferWriterBackend, CompactFormat> writer{ CompactFormat(), buffer, size };
+    details::write(writer, data, CompactFormat(), options);
+    return writer.backend().size();
+  }
+  else
+  {
+    GenericWriter<FixedBufferWriterBackend, PrettyFormat> writer{ PrettyFormat(), buffer, size };
+    details::write(writer, data, PrettyFormat(), options);
+    return writer.backend().size();
+  }
+}
+
+// The following functions write through a fixed-size buffer
+// and throw if the output fails.
+
+inline void stringify_to(std::ostream& out, const json::Json& data, StringifyOptions options = None)
+{
+  details::stringify_to(details::StreamSink(out), data, options);
+}
+
+inline void stringify_to(FILE* file, const json::Json& data, StringifyOptions options = None)
+{
+  details::stringify_to(details::FileSink(file), data, options);
+}
+
+#ifndef _WIN32
+inline void stringify_to_fd(int fd, const json::Json& data, StringifyOptions options = None)
+{
+  details::stringify_to(details::FdSink(fd), data, options);
 }
+#endif // !_WIN32
 
 } // namespace json
 
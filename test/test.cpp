@@ -5,10 +5,25 @@
 #include <gtest/gtest.h>
 
 #include "json-toolkit/json.h"
+#include "json-toolkit/builder.h"
+#include "json-toolkit/diff.h"
+#include "json-toolkit/frozen.h"
+#include "json-toolkit/parallel-stringify.h"
 #include "json-toolkit/parsing.h"
+#include "json-toolkit/patch.h"
+#include "json-toolkit/pointer.h"
 #include "json-toolkit/serialization.h"
 #include "json-toolkit/stringify.h"
 
+#include <clocale>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <unordered_set>
+
 #if __cplusplus >= 201703L
 #include <variant>
 #endif
@@ -106,6 +121,645 @@ TEST(jsontest, objects)
   ASSERT_TRUE(obj != val);
 }
 
+TEST(jsontest, shapes)
+{
+  json::Json records = json::parse("[{ id: 1, name: 'a' }, { name: 'b', id: 2 }, { id: 3, name: 'c', extra: true }]");
+
+  auto* first = static_cast<const json::details::ObjectNode*>(records[0].impl().get());
+  auto* second = static_cast<const json::details::ObjectNode*>(records[1].impl().get());
+  auto* third = static_cast<const json::details::ObjectNode*>(records[2].impl().get());
+
+  ASSERT_TRUE(first->shaped());
+  ASSERT_EQ(first->shape, second->shape);
+  ASSERT_NE(first->shape, third->shape);
+
+  ASSERT_EQ(records[1]["id"], 2);
+  ASSERT_EQ(records[1]["name"], "b");
+  const json::Json record = records.at(1);
+  ASSERT_EQ(record["missing"], nullptr);
+  ASSERT_EQ(records[1].toObject().size(), 2);
+
+  json::Key name{ "name" };
+  ASSERT_EQ(records[0][name], "a");
+  ASSERT_EQ(records[1][name], "b");
+  ASSERT_EQ(records[2][name], "c");
+
+  std::vector<std::string> keys;
+  for (const auto& e : records[2].toObject().data())
+    keys.push_back(e.first);
+  ASSERT_EQ(keys, std::vector<std::string>({ "extra", "id", "name" }));
+
+  const json::Object first_record = records[0].toObject();
+  ASSERT_EQ(first_record.data().size(), 2);
+  ASSERT_EQ(first_record.data().at("name"), "a");
+  ASSERT_EQ(first_record->count("id"), 1);
+  ASSERT_THROW(first_record.data().at("missing"), std::out_of_range);
+  ASSERT_TRUE(first->shaped());
+
+  json::Json expected = {};
+  expected["id"] = 2;
+  expected["name"] = "b";
+  ASSERT_EQ(records[1], expected);
+
+  records[1]["id"] = 4;
+  ASSERT_TRUE(second->shaped());
+  ASSERT_EQ(records[1]["id"], 4);
+
+  records[1]["age"] = 18;
+  ASSERT_FALSE(second->shaped());
+  ASSERT_EQ(records[1].toObject().data().size(), 3);
+  ASSERT_EQ(records[1]["name"], "b");
+  ASSERT_EQ(records[0]["id"], 1);
+
+  json::Json doc = json::parse("{ a: 1, b: 2 }");
+  json::Json& a = doc["a"];
+  doc["c"] = 3;
+  a = 42;
+  ASSERT_EQ(doc["a"], 42);
+}
+
+TEST(jsontest, stringPool)
+{
+  json::StringPool pool{ 16, 8 };
+
+  json::Json a{ "ok", pool };
+  json::Json b{ "ok", pool };
+  json::Json c{ "failure", pool };
+  json::Json d{ "too long to be interned", pool };
+
+  ASSERT_EQ(a.impl(), b.impl());
+  ASSERT_NE(a, c);
+  ASSERT_EQ(a, json::Json("ok"));
+  ASSERT_EQ(d, json::Json("too long to be interned"));
+  ASSERT_EQ(pool.size(), 2);
+
+  pool.clear();
+  json::Json e{ "ok", pool };
+  ASSERT_NE(a.impl(), e.impl());
+  ASSERT_EQ(a, e);
+
+  json::StringPool doc_pool;
+  json::Json doc = json::parse("[{ status: 'ok' }, { status: 'ok' }, { status: 'ko' }]", doc_pool);
+  ASSERT_EQ(doc[0]["status"].impl(), doc[1]["status"].impl());
+  ASSERT_NE(doc[0]["status"], doc[2]["status"]);
+  ASSERT_EQ(doc_pool.size(), 2);
+}
+
+TEST(jsontest, moveAndEmplace)
+{
+  std::string str = "Hello World!";
+  json::Json val = std::move(str);
+  ASSERT_EQ(val, "Hello World!");
+
+  json::Json other = std::move(val);
+  ASSERT_TRUE(val.isNull());
+  ASSERT_EQ(other, "Hello World!");
+
+  json::Json vec = json::Array{ 1, 2.5, "three" };
+  ASSERT_EQ(vec.length(), 3);
+  ASSERT_EQ(vec[2], "three");
+
+  vec.reserve(8);
+  vec.push(std::move(other));
+  vec.emplace_back(std::string("five"));
+  ASSERT_EQ(vec[4], "five");
+  ASSERT_EQ(vec.length(), 5);
+  ASSERT_EQ(vec[3], "Hello World!");
+
+  json::Json obj = json::Object{ { "a", 1 }, { "b", true } };
+  ASSERT_EQ(obj["a"], 1);
+  ASSERT_EQ(obj["b"], true);
+
+  obj.emplace("c", "see");
+  obj.emplace("a", 2);
+  ASSERT_EQ(obj.toObject().size(), 3);
+  ASSERT_EQ(obj["a"], 2);
+  ASSERT_EQ(obj["c"], "see");
+}
+
+TEST(jsontest, builder)
+{
+  json::Json doc = json::Builder().start_object()
+      .key("name").value("Alice")
+      .key("age").value(18)
+      .key("languages").start_array().reserve(2).value("C++").value(std::string("JSON")).end_array()
+      .key("book").start_object().key("year").value(2019).end_object()
+    .end_object().build();
+
+  json::Json expected = json::parse("{ name: 'Alice', age: 18, languages: ['C++', 'JSON'], book: { year: 2019 } }");
+  ASSERT_EQ(doc, expected);
+
+  json::Builder builder;
+  builder.start_array();
+  ASSERT_ANY_THROW(builder.key("name"));
+  ASSERT_ANY_THROW(builder.end_object());
+  ASSERT_ANY_THROW(builder.build());
+  builder.value(json::Array{ 1, 2 }).end_array();
+  ASSERT_TRUE(builder.done());
+  ASSERT_ANY_THROW(builder.value(3));
+  ASSERT_EQ(builder.build(), json::Json(json::Array{ json::Array{ 1, 2 } }));
+}
+
+TEST(jsontest, deepDestruction)
+{
+  {
+    json::Json root = json::Array();
+    json::Json current = root;
+
+    for (int i(0); i < 500000; ++i)
+    {
+      json::Json next = (i % 2 == 0) ? json::Json(json::Array()) : json::Json(json::Object());
+      if (current.isArray())
+        current.push(next);
+      else
+        current["child"] = next;
+      current = next;
+    }
+  }
+
+  json::set_deferred_destruction(true);
+  ASSERT_TRUE(json::deferred_destruction());
+
+  {
+    json::Json root = json::Array();
+
+    for (int i(0); i < 1000; ++i)
+      root.push(json::Array{ i, i + 1, json::Object{ { "i", i } } });
+  }
+
+  json::flush_deferred_destruction();
+  json::set_deferred_destruction(false);
+}
+
+TEST(jsontest, hashing)
+{
+  json::Json a = json::parse("{ name: 'Alice', tags: [1, 2, 3], ratio: 0.5 }");
+  json::Json b = json::Object();
+  b["tags"] = json::Array{ 1, 2, 3 };
+  b["name"] = "Alice";
+  b["ratio"] = 0.5;
+
+  ASSERT_EQ(json::hash(a), json::hash(b));
+  ASSERT_NE(json::hash(json::Json(1)), json::hash(json::Json(1.0)));
+  ASSERT_EQ(json::hash(json::Json(0.0)), json::hash(json::Json(-0.0)));
+
+  size_t h = json::hash(b);
+  b["tags"].push(4);
+  ASSERT_NE(json::hash(b), h);
+  ASSERT_NE(a, b);
+
+  b["tags"][3] = 5;
+  b["tags"].toArray().data().pop_back();
+  ASSERT_EQ(json::hash(b), h);
+  ASSERT_EQ(a, b);
+
+  // modifications through a child are seen by its parents
+  json::Json x = json::parse("{ t: [1, 2, 3] }");
+  json::Json y = json::parse("{ t: [1, 2, 3, 4] }");
+  json::Json t = x["t"];
+  json::hash(x);
+  json::hash(y);
+  t.push(4);
+  ASSERT_EQ(x, y);
+  ASSERT_EQ(json::hash(x), json::hash(y));
+  ASSERT_EQ(json::diff(x, y).length(), 0);
+  t.push(5);
+  ASSERT_NE(x, y);
+  ASSERT_EQ(json::diff(x, y).length(), 1);
+
+  std::unordered_set<json::Json> events;
+  events.insert(a);
+  events.insert(b);
+  events.insert(json::parse("{ name: 'Bob' }"));
+  events.insert(json::parse("{ name: 'Bob' }"));
+  ASSERT_EQ(events.size(), 2);
+}
+
+TEST(jsontest, packedArrays)
+{
+  json::Array ints = json::parse("[1, 2, 3, 4]").toArray();
+  ASSERT_TRUE(ints.packed());
+  ASSERT_EQ(ints.integers().size(), 4);
+  ASSERT_EQ(ints.integers()[2], 3);
+  ASSERT_TRUE(ints.numbers().empty());
+  ASSERT_EQ(ints.at(3), 4);
+  ASSERT_EQ(ints, json::Array({ 1, 2, 3, 4 }));
+  ASSERT_EQ(json::hash(ints), json::hash(json::Array({ 1, 2, 3, 4 })));
+
+  ints.push(5);
+  ASSERT_TRUE(ints.packed());
+  ASSERT_EQ(ints.length(), 5);
+
+  ints.push(6.5);
+  ASSERT_FALSE(ints.packed());
+  ASSERT_EQ(ints.length(), 6);
+  ASSERT_EQ(ints.at(4), 5);
+  ASSERT_EQ(ints.at(5), 6.5);
+
+  json::Array numbers{ std::vector<double>{ 0.5, 1.5 } };
+  ASSERT_TRUE(numbers.packed());
+  double sum = 0;
+  for (double x : numbers.numbers())
+    sum += x;
+  ASSERT_EQ(sum, 2.0);
+  ASSERT_EQ(json::parse(json::stringify(numbers)), numbers);
+
+  const json::Array const_numbers = numbers;
+  sum = 0;
+  for (const json::Json& x : const_numbers.data())
+    sum += x.toNumber();
+  ASSERT_EQ(sum, 2.0);
+  ASSERT_EQ(const_numbers->size(), 2);
+  ASSERT_TRUE(numbers.packed());
+  numbers.push(2.5);
+  ASSERT_TRUE(numbers.packed());
+  ASSERT_EQ(const_numbers->size(), 3);
+  ASSERT_EQ(const_numbers.data().back(), 2.5);
+
+  json::Json values = json::parse("[1, 2, 3]");
+  values.emplace_back(4);
+  ASSERT_TRUE(values.toArray().packed());
+  ASSERT_EQ(values.length(), 4);
+
+  json::Array reserved;
+  reserved.reserve(16);
+  reserved.push(1);
+  ASSERT_TRUE(reserved.packed());
+  ASSERT_GE(static_cast<const json::details::ArrayNode*>(reserved.impl().get())->integers.capacity(), 16);
+
+  numbers[0] = "half";
+  ASSERT_FALSE(numbers.packed());
+  ASSERT_EQ(numbers.at(1), 1.5);
+
+  ASSERT_FALSE(json::parse("[1, 'two']").toArray().packed());
+  ASSERT_FALSE(json::parse("[1, 2.5]").toArray().packed());
+}
+
+TEST(jsontest, views)
+{
+  json::Json doc = json::parse("{ name: 'Alice', scores: [1, 2, 3], tags: ['a', null, true] }");
+  const long use_count = doc.impl().use_count();
+
+  json::JsonView view = doc;
+  ASSERT_TRUE(view.isObject());
+  ASSERT_EQ(view.size(), 3);
+  ASSERT_EQ(view["name"].toString(), "Alice");
+  ASSERT_TRUE(view["missing"].isNull());
+
+  json::JsonView scores = view["scores"];
+  ASSERT_EQ(scores.length(), 3);
+  ASSERT_EQ(scores[1].toInt(), 2);
+  ASSERT_EQ(scores[0].json(), nullptr);
+
+  int sum = 0;
+  for (json::JsonView e : scores.elements())
+    sum += e.toInt();
+  ASSERT_EQ(sum, 6);
+
+  std::vector<std::string> keys;
+  for (auto field : view.fields())
+    keys.push_back(field.first);
+  ASSERT_EQ(keys, std::vector<std::string>({ "name", "scores", "tags" }));
+
+  ASSERT_TRUE(view["tags"][1].isNull());
+  ASSERT_TRUE(view["tags"][2].toBool());
+  ASSERT_THROW(view["tags"].at(3), std::out_of_range);
+
+  ASSERT_EQ(doc.impl().use_count(), use_count);
+
+  ASSERT_EQ(scores.at(0), json::JsonView(doc["scores"].toArray().at(0)));
+  ASSERT_EQ(json::hash(view), json::hash(doc));
+  ASSERT_EQ(view["tags"].toJson(), doc["tags"]);
+  ASSERT_EQ(scores[2].toJson(), json::Json(3));
+}
+
+TEST(jsontest, immortalSingletons)
+{
+  json::Json a = nullptr;
+  json::Json b = a;
+  ASSERT_EQ(a.impl(), b.impl());
+  ASSERT_EQ(a.impl().use_count(), 0);
+
+  json::Json t = true;
+  ASSERT_EQ(t.impl(), json::Json(true).impl());
+  ASSERT_NE(t.impl(), json::Json(false).impl());
+  ASSERT_EQ(t.impl().use_count(), 0);
+
+  t = false;
+  ASSERT_FALSE(t.toBool());
+
+  json::Json moved = std::move(t);
+  ASSERT_TRUE(t.isNull());
+  ASSERT_EQ(t.impl().use_count(), 0);
+  ASSERT_FALSE(moved.toBool());
+}
+
+TEST(jsontest, emptyContainers)
+{
+  json::Array e;
+  json::Json o = json::Object{ { "x", e } };
+  e.push(1);
+  ASSERT_EQ(o["x"].length(), 1);
+
+  json::Json a = json::Object();
+  json::Json b = a;
+  a["x"] = 1;
+  ASSERT_EQ(b["x"], 1);
+
+  json::Json c = json::parse("{ list: [], map: {} }");
+  json::Json list = c["list"];
+  json::Json map = c["map"];
+  list.push(2);
+  map["y"] = 3;
+  ASSERT_EQ(c, json::parse("{ list: [2], map: { y: 3 } }"));
+
+  json::Json d;
+  json::Json f;
+  d["x"] = 1;
+  f["y"] = 2;
+  ASSERT_EQ(d, json::parse("{ x: 1 }"));
+  ASSERT_EQ(f, json::parse("{ y: 2 }"));
+
+  json::Frozen frozen = json::freeze(json::parse("{ list: [], map: {} }"));
+  ASSERT_EQ(frozen.json()["list"].impl().use_count(), 0);
+  ASSERT_EQ(frozen.json()["map"].impl(), json::freeze(json::Object()).json().impl());
+
+  json::Json copy = frozen.json();
+  copy["list"].push(4);
+  ASSERT_EQ(copy["list"].length(), 1);
+  ASSERT_EQ(frozen.view()["list"].length(), 0);
+  ASSERT_EQ(json::freeze(json::Array()).view().length(), 0);
+}
+
+TEST(jsontest, frozen)
+{
+  json::Json config = json::parse("{ routes: [{ path: '/', port: 80 }, { path: '/api', port: 8080 }], ids: [1, 2, 3] }");
+  json::Object large;
+  for (int i(0); i < 40; ++i)
+    large["key" + std::to_string(i)] = i;
+  config["large"] = large;
+
+  json::Frozen frozen = json::freeze(config);
+  ASSERT_EQ(frozen.json(), config);
+  ASSERT_NE(frozen.json().impl(), config.impl());
+
+  json::JsonView view = frozen.view();
+  ASSERT_EQ(view["routes"][1]["port"].toInt(), 8080);
+  ASSERT_EQ(view["large"]["key33"].toInt(), 33);
+  ASSERT_TRUE(view["large"]["key40"].isNull());
+  ASSERT_EQ(view["ids"][2].toInt(), 3);
+
+  config["routes"][0]["port"] = 81;
+  ASSERT_EQ(view["routes"][0]["port"].toInt(), 80);
+
+  json::Json copy = frozen.json();
+  copy["routes"][1]["port"] = 9090;
+  ASSERT_EQ(copy["routes"][1]["port"], 9090);
+  ASSERT_EQ(view["routes"][1]["port"].toInt(), 8080);
+  ASSERT_EQ(copy["ids"].impl(), frozen.json()["ids"].impl());
+  ASSERT_EQ(copy["routes"][0].impl(), frozen.json()["routes"].at(0).impl());
+
+  const json::Array ids = frozen.json()["ids"].toArray();
+  ASSERT_EQ(ids.data().size(), 3);
+  ASSERT_EQ(ids.data()[2].toInt(), 3);
+  ASSERT_TRUE(ids.packed());
+
+  json::AtomicFrozen current{ frozen };
+  std::vector<std::thread> readers;
+  std::atomic<int> sum{ 0 };
+  for (int i(0); i < 4; ++i)
+  {
+    readers.emplace_back([&current, &sum]() {
+      for (int j(0); j < 1000; ++j)
+      {
+        json::Frozen snapshot = current.load();
+        sum += snapshot.view()["ids"].length();
+      }
+      });
+  }
+  current.store(json::freeze(copy));
+  for (std::thread& t : readers)
+    t.join();
+
+  ASSERT_EQ(sum.load(), 4 * 1000 * 3);
+  ASSERT_EQ(current.load().view()["routes"][1]["port"].toInt(), 9090);
+  ASSERT_EQ(json::freeze(frozen.json()).json().impl(), frozen.json().impl());
+}
+
+TEST(jsontest, sealedObjects)
+{
+  json::Object flags;
+  for (int i(0); i < 3000; ++i)
+    flags["flag_" + std::to_string(i)] = i;
+
+  flags.seal();
+  auto shape = static_cast<const json::details::ObjectNode*>(flags.impl().get())->shape;
+  ASSERT_TRUE(shape && shape->sealed());
+
+  for (int i(0); i < 3000; ++i)
+    ASSERT_EQ(json::JsonView(flags)["flag_" + std::to_string(i)].toInt(), i);
+  ASSERT_TRUE(json::JsonView(flags)["flag_3000"].isNull());
+  ASSERT_TRUE(json::JsonView(flags)[""].isNull());
+
+  const json::Key key{ "flag_42" };
+  ASSERT_EQ(json::JsonView(flags)[key].toInt(), 42);
+
+  flags["extra"] = true;
+  ASSERT_FALSE(static_cast<const json::details::ObjectNode*>(flags.impl().get())->shaped());
+  ASSERT_EQ(flags["flag_7"], 7);
+
+  json::Frozen frozen = json::freeze(flags);
+  shape = static_cast<const json::details::ObjectNode*>(frozen.json().impl().get())->shape;
+  ASSERT_TRUE(shape->sealed());
+  ASSERT_TRUE(frozen.view()["extra"].toBool());
+
+  json::Object small{ { "a", 1 }, { "b", 2 } };
+  small.seal();
+  ASSERT_EQ(small["b"], 2);
+}
+
+TEST(jsontest, keyLookups)
+{
+  using namespace json::literals;
+
+  json::Json records = json::parse("[{ id: 1, name: 'Alice' }, { id: 2, name: 'Bob' }]");
+  const json::Json bob = records.at(1);
+
+  static const json::Key name = "name"_key;
+  ASSERT_EQ(name.str(), "name");
+  ASSERT_EQ(name.size(), 4);
+  ASSERT_EQ(name.hash(), json::details::hash_bytes("name", 4));
+  ASSERT_EQ(bob[name], "Bob");
+  const json::Json carol = json::parse("{ name: 'Carol' }");
+  ASSERT_EQ(carol[name], "Carol");
+  ASSERT_EQ(bob[name], "Bob");
+
+  const char* id = "id";
+  ASSERT_EQ(bob[id], 2);
+  ASSERT_TRUE(bob["unknown"].isNull());
+  ASSERT_EQ(json::JsonView(bob)["name"].toString(), "Bob");
+
+  json::Json alice = records.at(0);
+  alice["name"] = "Alicia";
+  alice["age"] = 30;
+  ASSERT_EQ(alice["name"], "Alicia");
+  ASSERT_EQ(alice["age"], 30);
+  ASSERT_EQ(alice["id"], 1);
+
+#if __cplusplus >= 201703L
+  std::string_view key = "name";
+  ASSERT_EQ(bob[key], "Bob");
+  ASSERT_EQ(json::JsonView(alice)[key].toString(), "Alicia");
+  alice[std::string_view("id")] = 3;
+  ASSERT_EQ(alice["id"], 3);
+#endif
+}
+
+TEST(jsontest, pointers)
+{
+  // example from RFC 6901
+  json::Json doc = json::Object();
+  doc["foo"] = json::Array{ "bar", "baz" };
+  doc[""] = 0;
+  doc["a/b"] = 1;
+  doc["c%d"] = 2;
+  doc["e^f"] = 3;
+  doc["g|h"] = 4;
+  doc["i\\j"] = 5;
+  doc["k\"l"] = 6;
+  doc[" "] = 7;
+  doc["m~n"] = 8;
+  json::JsonView root = doc;
+
+  ASSERT_EQ(json::Pointer("")(root), root);
+  ASSERT_EQ(json::Pointer("/foo")(root).length(), 2);
+  ASSERT_EQ(json::Pointer("/foo/0")(root).toString(), "bar");
+  ASSERT_EQ(json::Pointer("/")(root).toInt(), 0);
+  ASSERT_EQ(json::Pointer("/a~1b")(root).toInt(), 1);
+  ASSERT_EQ(json::Pointer("/c%d")(root).toInt(), 2);
+  ASSERT_EQ(json::Pointer("/i\\j")(root).toInt(), 5);
+  ASSERT_EQ(json::Pointer("/k\"l")(root).toInt(), 6);
+  ASSERT_EQ(json::Pointer("/ ")(root).toInt(), 7);
+  ASSERT_EQ(json::Pointer("/m~0n")(root).toInt(), 8);
+
+  json::Pointer ptr{ "/a~1b/m~0n" };
+  ASSERT_EQ(ptr.size(), 2);
+  ASSERT_EQ(ptr.tokens()[0].key.str(), "a/b");
+  ASSERT_EQ(ptr.str(), "/a~1b/m~0n");
+  ASSERT_EQ(ptr.parent().str(), "/a~1b");
+
+  json::JsonView result;
+  ASSERT_FALSE(json::Pointer("/foo/2").resolve(root, result));
+  ASSERT_FALSE(json::Pointer("/foo/01").resolve(root, result));
+  ASSERT_FALSE(json::Pointer("/foo/-").resolve(root, result));
+  ASSERT_FALSE(json::Pointer("/missing").resolve(root, result));
+  ASSERT_TRUE(json::Pointer("/foo/-").tokens().back().isEnd());
+  ASSERT_THROW(json::Pointer("foo"), std::runtime_error);
+  ASSERT_THROW(json::Pointer("/~2"), std::runtime_error);
+
+  json::Json message = json::parse("{ header: { type: 'order', id: 7 }, body: { items: [3, 4, 5] } }");
+  json::PointerSet rules{ { json::Pointer("/header/type"), json::Pointer("/header/id"), json::Pointer("/body/items/1"), json::Pointer("/body/total") } };
+  ASSERT_EQ(rules.size(), 4);
+  ASSERT_EQ(rules.add(json::Pointer("/header")), 4);
+
+  std::vector<json::JsonView> values = rules.evaluate(message);
+  ASSERT_EQ(values.size(), 5);
+  ASSERT_EQ(values[0].toString(), "order");
+  ASSERT_EQ(values[1].toInt(), 7);
+  ASSERT_EQ(values[2].toInt(), 4);
+  ASSERT_TRUE(values[3].isNull());
+  ASSERT_TRUE(values[4].isObject());
+}
+
+TEST(jsontest, patches)
+{
+  json::Json doc = json::parse("{ foo: 'bar', list: [1, 2, 3], nested: { a: { b: 1 } }, other: { x: 1 } }");
+
+  json::Json ops = json::parse("["
+    "{ op: 'add', path: '/baz', value: 'qux' },"
+    "{ op: 'add', path: '/list/1', value: 'one' },"
+    "{ op: 'add', path: '/list/-', value: 4 },"
+    "{ op: 'remove', path: '/foo' },"
+    "{ op: 'replace', path: '/nested/a/b', value: 2 },"
+    "{ op: 'copy', from: '/nested/a', path: '/copied' },"
+    "{ op: 'move', from: '/baz', path: '/moved' },"
+    "{ op: 'test', path: '/list/0', value: 1 }"
+    "]");
+
+  json::Json copy = doc;
+  json::Json result = json::patch(doc, ops);
+  ASSERT_EQ(result, json::parse("{ list: [1, 'one', 2, 3, 4], nested: { a: { b: 2 } }, other: { x: 1 }, copied: { b: 2 }, moved: 'qux' }"));
+  ASSERT_EQ(doc, json::parse("{ foo: 'bar', list: [1, 2, 3], nested: { a: { b: 1 } }, other: { x: 1 } }"));
+  ASSERT_EQ(doc.impl(), copy.impl());
+  ASSERT_EQ(result["other"].impl(), doc["other"].impl());
+
+  // uniquely owned documents are modified in place
+  copy = nullptr;
+  const json::details::Node* root = doc.impl().get();
+  const json::details::Node* nested = doc["nested"].impl().get();
+  json::apply_patch(doc, json::parse("[{ op: 'replace', path: '/nested/a', value: 0 }]"));
+  ASSERT_EQ(doc.impl().get(), root);
+  ASSERT_EQ(doc["nested"].impl().get(), nested);
+  ASSERT_EQ(doc["nested"]["a"], 0);
+
+  ASSERT_THROW(json::apply_patch(doc, json::parse("[{ op: 'test', path: '/foo', value: 'baz' }]")), std::runtime_error);
+  ASSERT_THROW(json::apply_patch(doc, json::parse("[{ op: 'remove', path: '/missing' }]")), std::runtime_error);
+  ASSERT_THROW(json::apply_patch(doc, json::parse("[{ op: 'add', path: '/list/9', value: 1 }]")), std::runtime_error);
+  ASSERT_THROW(json::apply_patch(doc, json::parse("[{ op: 'move', from: '/nested', path: '/nested/a' }]")), std::runtime_error);
+  ASSERT_THROW(json::apply_patch(doc, json::parse("[{ op: 'frobnicate', path: '' }]")), std::runtime_error);
+
+  // example from RFC 7386
+  json::Json target = json::parse("{ title: 'Goodbye!', author: { givenName: 'John', familyName: 'Doe' }, tags: ['example', 'sample'], content: 'This will be unchanged' }");
+  json::Json merge = json::parse("{ title: 'Hello!', phoneNumber: '+01-123-456-7890', author: { familyName: null }, tags: ['example'] }");
+  json::Json merged = json::merge_patch(target, merge);
+  ASSERT_EQ(merged, json::parse("{ title: 'Hello!', author: { givenName: 'John' }, tags: ['example'], content: 'This will be unchanged', phoneNumber: '+01-123-456-7890' }"));
+  ASSERT_EQ(target["author"]["familyName"], "Doe");
+
+  json::apply_merge_patch(target, json::parse("{ a: { b: { c: null } } }"));
+  ASSERT_EQ(target["a"], json::parse("{ b: {} }"));
+  json::apply_merge_patch(target, json::Json(3));
+  ASSERT_EQ(target, 3);
+}
+
+TEST(jsontest, diff)
+{
+  json::Json a = json::parse("{ name: 'state', list: [1, 2, 3, 4, 5], items: [{ id: 1 }, { id: 2 }, { id: 3 }], meta: { 'a/b': 1, 'c d': 2 }, gone: true }");
+  json::Json b = json::parse("{ name: 'state', list: [1, 2, 9, 3, 5, 6], items: [{ id: 1 }, { id: 3, x: 1 }], meta: { 'a/b': 2, 'c d': 2 }, added: [] }");
+
+  json::Json patch = json::diff(a, b);
+  ASSERT_EQ(json::patch(a, patch), b);
+  ASSERT_EQ(json::diff(a, a).length(), 0);
+  ASSERT_EQ(json::diff(a, json::parse(json::stringify(a))).length(), 0);
+
+  json::Json ops = json::diff(json::parse("{ x: { 'a/b': 1 } }"), json::parse("{ x: { 'a/b': 2 } }"));
+  ASSERT_EQ(ops.length(), 1);
+  ASSERT_EQ(ops.at(0)["path"], "/x/a~1b");
+  ASSERT_EQ(ops.at(0)["value"], 2);
+
+  // a single insertion in a long array gives a single operation
+  json::Array long_array;
+  for (int i(0); i < 1000; ++i)
+    long_array.push(json::Object{ { "i", i } });
+  json::Json modified = json::patch(long_array, json::parse("[{ op: 'add', path: '/500', value: 'new' }]"));
+  ops = json::diff(long_array, modified);
+  ASSERT_EQ(ops, json::parse("[{ op: 'add', path: '/500', value: 'new' }]"));
+
+  // shared subtrees are skipped
+  json::Json c = json::patch(b, json::parse("[{ op: 'replace', path: '/name', value: 'next' }]"));
+  ASSERT_EQ(c["items"].impl(), b["items"].impl());
+  ASSERT_EQ(json::diff(b, c), json::parse("[{ op: 'replace', path: '/name', value: 'next' }]"));
+
+  json::Frozen frozen_a = json::freeze(a);
+  ASSERT_EQ(json::diff(frozen_a.json(), json::freeze(json::parse(json::stringify(a))).json()).length(), 0);
+  ASSERT_EQ(json::patch(a, json::diff(frozen_a.json(), json::freeze(b).json())), b);
+
+  ASSERT_EQ(json::patch(json::Json(1), json::diff(json::Json(1), json::Json("one"))), "one");
+  json::Json x = json::parse("[[1, 2], [3], 4, 'a', null]");
+  json::Json y = json::parse("[[2], 4, [3, 3], 'b']");
+  ASSERT_EQ(json::patch(x, json::diff(x, y)), y);
+  ASSERT_EQ(json::patch(y, json::diff(y, x)), x);
+}
+
 struct Point
 {
   int x; 
@@ -179,6 +833,18 @@ TEST(jsontest, templateSerialization)
     pts = s.decode<decltype(pts)>(data);
     ASSERT_EQ(pts.size(), 2);
     ASSERT_EQ(pts.back().y, 1);
+
+    pts = s.decode<decltype(pts)>(JsonView(data));
+    ASSERT_EQ(pts.front().x, 1);
+  }
+
+  {
+    Json data = json::parse("{ ids: [1, 2, 3], names: ['a', 'b'] }");
+    JsonView view{ data };
+
+    ASSERT_EQ(s.decode<std::vector<int>>(view["ids"]), std::vector<int>({ 1, 2, 3 }));
+    ASSERT_EQ(s.decode<std::vector<std::string>>(view["names"]), std::vector<std::string>({ "a", "b" }));
+    ASSERT_TRUE(data["ids"].toArray().packed());
   }
 }
 
@@ -361,4 +1027,417 @@ TEST(jsontest, stringify)
   json::Object parsed = json::parse(str).toObject();
 
   ASSERT_EQ(obj, parsed);
-}
\ No newline at end of file
+}
+
+TEST(jsontest, writerBackend)
+{
+  json::DefaultWriterBackend backend;
+  backend.reserve(64);
+  backend << json::CharCategory::LBracket << 42 << json::CharCategory::Comma << 0.5 << json::CharCategory::Comma;
+  backend << nullptr << json::CharCategory::Comma << false << json::CharCategory::Comma;
+  backend << std::string("a\\b\tc\nd") << json::CharCategory::RBracket;
+  ASSERT_EQ(backend.str(), "[42,0.5,null,false,a\\\\b\\tc\\nd]");
+
+  const char* data = backend.str().data();
+  std::string result = backend.result();
+  ASSERT_EQ(result.data(), data);
+  ASSERT_EQ(backend.size(), 0);
+}
+
+TEST(jsontest, numberFormatting)
+{
+  auto format = [](double value) -> std::string {
+    char buffer[json::details::max_double_length];
+    return std::string(buffer, json::details::format_double(value, buffer));
+  };
+
+  ASSERT_EQ(format(3.14159265), "3.14159265");
+  ASSERT_EQ(format(0.1), "0.1");
+  ASSERT_EQ(format(2.0), "2.0");
+  ASSERT_EQ(format(-0.0), "-0.0");
+  ASSERT_EQ(format(1e20), "100000000000000000000.0");
+  ASSERT_EQ(format(1e22), "1e22");
+  ASSERT_EQ(format(0.000001), "0.000001");
+  ASSERT_EQ(format(1.5e-7), "1.5e-7");
+  ASSERT_EQ(format(5e-324), "5e-324");
+  ASSERT_EQ(format(1.7976931348623157e308), "1.7976931348623157e308");
+
+  std::mt19937_64 rng{ 42 };
+  for (int i(0); i < 100000; ++i)
+  {
+    const uint64_t bits = rng();
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+
+    if (!std::isfinite(value))
+      continue;
+
+    const std::string str = format(value);
+    ASSERT_EQ(std::strtod(str.c_str(), nullptr), value) << str;
+    ASSERT_EQ(json::parse("[" + str + "]").at(0).toNumber(), value) << str;
+  }
+
+  ASSERT_EQ(json::parse(json::stringify(json::Array{ 5e-324, -2.2250738585072009e-308 })), json::Array({ 5e-324, -2.2250738585072009e-308 }));
+  ASSERT_THROW(json::parse("[1e400]"), std::out_of_range);
+
+  json::Array values{ 3.14159265, 2.0, -1e-10, 6.02214076e23 };
+  json::Json parsed = json::parse(json::stringify(values));
+  ASSERT_EQ(parsed, values);
+  ASSERT_TRUE(parsed.at(1).isNumber());
+
+  ASSERT_EQ(json::parse(json::stringify(json::Array{ std::numeric_limits<double>::infinity() })).at(0), nullptr);
+}
+
+TEST(jsontest, numberParsingLocale)
+{
+  const std::string previous = std::setlocale(LC_NUMERIC, nullptr);
+  const char* names[] = { "de_DE.UTF-8", "de_DE.utf8", "de_DE", "fr_FR.UTF-8", "fr_FR.utf8", "fr_FR" };
+  bool found = false;
+
+  for (const char* name : names)
+  {
+    if (std::setlocale(LC_NUMERIC, name) && std::localeconv()->decimal_point[0] == ',')
+    {
+      found = true;
+      break;
+    }
+  }
+
+  if (!found)
+  {
+    std::setlocale(LC_NUMERIC, previous.c_str());
+    GTEST_SKIP() << "no locale with a decimal comma is installed";
+  }
+
+  json::Json values = json::parse("[3.14, -0.5e-3, 1e10]");
+  const std::string str = json::stringify(values);
+  json::Json parsed = json::parse(str);
+  std::setlocale(LC_NUMERIC, previous.c_str());
+
+  ASSERT_EQ(values.at(0), 3.14);
+  ASSERT_EQ(values.at(1), -0.5e-3);
+  ASSERT_NE(str.find("10000000000.0"), std::string::npos);
+  ASSERT_EQ(parsed, values);
+}
+
+TEST(jsontest, integerFormatting)
+{
+  auto format = [](int64_t value) -> std::string {
+    char buffer[json::details::max_integer_length];
+    return std::string(buffer, json::details::format_integer(value, buffer));
+  };
+
+  ASSERT_EQ(format(0), "0");
+  ASSERT_EQ(format(7), "7");
+  ASSERT_EQ(format(42), "42");
+  ASSERT_EQ(format(-100), "-100");
+  ASSERT_EQ(format(std::numeric_limits<int64_t>::max()), "9223372036854775807");
+  ASSERT_EQ(format(std::numeric_limits<int64_t>::min()), "-9223372036854775808");
+
+  char buffer[json::details::max_integer_length];
+  ASSERT_EQ(std::string(buffer, json::details::format_integer(std::numeric_limits<uint64_t>::max(), buffer)), "18446744073709551615");
+
+  uint64_t power = 1;
+  for (int digits(1); digits <= 19; ++digits, power *= 10)
+  {
+    ASSERT_EQ(json::details::count_digits(power), digits);
+    ASSERT_EQ(json::details::count_digits(power * 10 - 1), digits);
+    ASSERT_EQ(format(static_cast<int64_t>(power)), std::to_string(power));
+  }
+
+  std::mt19937 rng{ 7 };
+  for (int i(0); i < 10000; ++i)
+  {
+    const int value = static_cast<int>(rng());
+    ASSERT_EQ(format(value), std::to_string(value));
+  }
+
+  json::DefaultWriterBackend backend;
+  backend << std::numeric_limits<int>::min() << json::CharCategory::Comma << 18446744073709551615ull;
+  ASSERT_EQ(backend.str(), "-2147483648,18446744073709551615");
+}
+
+TEST(jsontest, stringEscaping)
+{
+  auto escape = [](const std::string& str, bool ascii_only) -> std::string {
+    json::DefaultWriterBackend backend;
+    backend.ascii_only = ascii_only;
+    backend << str;
+    return backend.result();
+  };
+
+  ASSERT_EQ(escape("plain text", false), "plain text");
+  ASSERT_EQ(escape("say \"hi\"\\", false), "say \\\"hi\\\"\\\\");
+  ASSERT_EQ(escape("\b\f\n\r\t", false), "\\b\\f\\n\\r\\t");
+  ASSERT_EQ(escape(std::string("\x01\x1f\x7f", 3), false), "\\u0001\\u001f\x7f");
+  ASSERT_EQ(escape(std::string("a\0b", 3), false), "a\\u0000b");
+  ASSERT_EQ(escape("caf\xc3\xa9", false), "caf\xc3\xa9");
+
+  ASSERT_EQ(escape("caf\xc3\xa9", true), "caf\\u00e9");
+  ASSERT_EQ(escape("\xe2\x82\xac", true), "\\u20ac");
+  ASSERT_EQ(escape("\xf0\x9f\x98\x80", true), "\\ud83d\\ude00");
+  ASSERT_EQ(escape("\xff", true), "\\ufffd");
+  ASSERT_EQ(escape("\xc3", true), "\\ufffd");
+  ASSERT_EQ(escape("\xc0\xaf", true), "\\ufffd\\ufffd");
+
+  // long strings with escapes at every position of the vectorized scan
+  for (size_t pos(0); pos < 40; ++pos)
+  {
+    std::string str(40, 'x');
+    str[pos] = '"';
+    std::string expected = str.substr(0, pos) + "\\\"" + str.substr(pos + 1);
+    ASSERT_EQ(escape(str, false), expected);
+
+    str[pos] = '\xe9';
+    ASSERT_EQ(escape(str, false), str);
+    ASSERT_EQ(escape(str, true), str.substr(0, pos) + "\\ufffd" + str.substr(pos + 1));
+  }
+
+  json::Json doc = json::Object{ { "quote\"", "line\nbreak" } };
+  ASSERT_EQ(json::stringify(doc), "{\n  \"quote\\\"\": \"line\\nbreak\"\n}");
+  ASSERT_EQ(json::stringify(json::Json("\xc3\xa9"), json::AsciiOnly), "\"\\u00e9\"");
+}
+
+TEST(jsontest, stringifyFormats)
+{
+  json::Json doc = json::parse("{\"a\": [1, 2, {\"b\": null}], \"c\": {\"d\": \"e\", \"f\": {}}, \"g\": []}");
+
+  ASSERT_EQ(json::stringify(doc, json::Compact), "{\"a\":[1,2,{\"b\":null}],\"c\":{\"d\":\"e\",\"f\":{}},\"g\":[]}");
+  ASSERT_EQ(json::parse(json::stringify(doc, json::Compact)), doc);
+
+  const std::string pretty = "{\n  \"a\": [1, 2, {\n      \"b\": null\n    }],\n  \"c\": {\n    \"d\": \"e\",\n    \"f\": {}\n  },\n  \"g\": []\n}";
+  ASSERT_EQ(json::stringify(doc), pretty);
+  ASSERT_EQ(json::stringify(doc, json::PrettyFormat(2)), pretty);
+
+  ASSERT_EQ(json::stringify(doc["c"], json::PrettyFormat(4)), "{\n    \"d\": \"e\",\n    \"f\": {}\n}");
+  ASSERT_EQ(json::stringify(json::Json("\xc3\xa9"), json::Compact | json::AsciiOnly), "\"\\u00e9\"");
+
+  // indentation deeper than the precomputed one
+  json::Json nested = json::Array{ 0 };
+  for (int i(0); i < 20; ++i)
+    nested = json::Object{ { "k", nested } };
+  const std::string str = json::stringify(nested, json::PrettyFormat(3));
+  ASSERT_NE(str.find("\n" + std::string(60, ' ') + "\"k\": [0]"), std::string::npos);
+  ASSERT_EQ(json::parse(str), nested);
+}
+
+TEST(jsontest, streamingBackends)
+{
+  json::Json doc = json::Object{ { "name", "stream" }, { "values", json::Array{ 1, 2.5, nullptr, true, "x\ny" } }, { "nested", json::Object{ { "k", json::Array{} } } } };
+  const std::string expected = json::stringify(doc, json::Compact);
+
+  {
+    // a buffer smaller than some of the chunks
+    std::ostringstream out;
+    {
+      json::GenericWriter<json::StreamWriterBackend, json::CompactFormat> writer{ json::CompactFormat(), out, 7 };
+      json::details::write(writer, doc);
+      ASSERT_EQ(writer.backend().size(), expected.size());
+      writer.backend().flush();
+    }
+    ASSERT_EQ(out.str(), expected);
+  }
+
+  {
+    std::ostringstream out;
+    json::stringify_to(out, doc);
+    ASSERT_EQ(out.str(), json::stringify(doc));
+  }
+
+  auto read_file = [](FILE* file) -> std::string {
+    std::string content;
+    std::rewind(file);
+    char buffer[256];
+    size_t n;
+    while ((n = std::fread(buffer, 1, sizeof(buffer), file)) > 0)
+      content.append(buffer, n);
+    return content;
+  };
+
+  FILE* file = std::tmpfile();
+  ASSERT_NE(file, nullptr);
+  json::stringify_to(file, doc, json::Compact);
+  std::fflush(file);
+  ASSERT_EQ(read_file(file), expected);
+  std::fclose(file);
+
+#ifndef _WIN32
+  file = std::tmpfile();
+  ASSERT_NE(file, nullptr);
+  json::stringify_to_fd(fileno(file), doc, json::Compact);
+  ASSERT_EQ(read_file(file), expected);
+  std::fclose(file);
+
+  ASSERT_THROW(json::stringify_to_fd(-1, doc), std::runtime_error);
+#endif // !_WIN32
+}
+
+TEST(jsontest, serializedSize)
+{
+  json::Json doc = json::Object{
+    { "text", "caf\xc3\xa9 \"quoted\"\n" },
+    { "numbers", json::Array{ 0, -12, 2147483647, 0.1, 1e300, -2.5e-8 } },
+    { "flags", json::Array{ true, false, nullptr } },
+    { "nested", json::Object{ { "empty", json::Object{} }, { "list", json::Array{} } } },
+  };
+
+  for (json::StringifyOptions options : { json::None, json::Compact, json::AsciiOnly, json::Compact | json::AsciiOnly })
+  {
+    const std::string str = json::stringify(doc, options);
+    ASSERT_EQ(json::serialized_size(doc, options), str.size());
+    ASSERT_EQ(json::stringify(doc, options | json::Presize), str);
+    ASSERT_EQ(json::serialized_size(doc, json::PrettyFormat(4), options), json::stringify(doc, json::PrettyFormat(4), options).size());
+
+    std::vector<char> buffer(str.size());
+    ASSERT_EQ(json::stringify_to(buffer.data(), buffer.size(), doc, options), str.size());
+    ASSERT_EQ(std::string(buffer.data(), buffer.size()), str);
+
+    ASSERT_THROW(json::stringify_to(buffer.data(), buffer.size() - 1, doc, options), std::runtime_error);
+  }
+
+  ASSERT_EQ(json::serialized_size(json::Json(nullptr)), 4);
+}
+
+TEST(jsontest, deepStringify)
+{
+  const int depth = 200000;
+  json::Json root = json::Array{ 1 };
+
+  for (int i(0); i < depth; ++i)
+  {
+    if (i % 2 == 0)
+      root = json::Array{ std::move(root) };
+    else
+      root = json::Object{ { "k", std::move(root) } };
+  }
+
+  const std::string str = json::stringify(root, json::Compact);
+  ASSERT_EQ(str.size(), json::serialized_size(root, json::Compact));
+  ASSERT_EQ(str.size(), 3 + (depth / 2) * (2 + 6));
+  ASSERT_EQ(str.substr(0, 8), "{\"k\":[{\"");
+  ASSERT_EQ(str.substr(str.size() - 6), "]}]}]}");
+
+  // packed arrays and shaped objects in the same document
+  json::Json doc = json::Array{ json::Array{ 1, 2, 3 }, json::Array{ 0.5, 1.5 }, json::Object{ { "a", 1 }, { "b", json::Array{} } }, json::Object{} };
+  ASSERT_EQ(json::stringify(doc, json::Compact), "[[1,2,3],[0.5,1.5],{\"a\":1,\"b\":[]},{}]");
+}
+
+TEST(jsontest, cachedFragments)
+{
+  auto fragment = [](const json::Json& value) -> std::shared_ptr<const json::details::Fragment> {
+    auto* node = static_cast<const json::details::ContainerNode*>(value.impl().get());
+    return std::atomic_load(&node->fragment_cache);
+  };
+
+  json::Json users = json::Array();
+  for (int i(0); i < 100; ++i)
+    users.push(json::Object{ { "id", i }, { "name", "user #" + std::to_string(i) }, { "profile", json::Object{ { "bio", "member since " + std::to_string(2000 + i) } } } });
+
+  json::Json doc = json::Object{
+    { "users", users },
+    { "status", json::Object{ { "state", "running" }, { "load", 0.25 } } },
+    { "tags", json::Array{ "a", "b" } },
+  };
+
+  // documents that are not frozen are always written
+  json::Json mutable_users = doc["users"];
+  ASSERT_EQ(json::stringify(doc, json::Compact | json::CacheFragments), json::stringify(doc, json::Compact));
+  ASSERT_EQ(fragment(doc), nullptr);
+  mutable_users.push(42);
+  ASSERT_EQ(json::stringify(doc, json::Compact | json::CacheFragments), json::stringify(doc, json::Compact));
+
+  json::Frozen frozen = json::freeze(doc);
+  const json::Json& root = frozen.json();
+
+  for (json::StringifyOptions format : { json::None, json::Compact })
+  {
+    const json::StringifyOptions options = format | json::CacheFragments;
+
+    ASSERT_EQ(json::stringify(root, options), json::stringify(root, format));
+    ASSERT_NE(fragment(root["status"]), nullptr);
+    ASSERT_NE(fragment(root["users"].at(3)), nullptr);
+    // too large to be recorded
+    ASSERT_EQ(fragment(root), nullptr);
+    ASSERT_EQ(fragment(root["users"]), nullptr);
+    // too small to be recorded
+    ASSERT_EQ(fragment(root["tags"]), nullptr);
+    // enclosed in a recorded container
+    ASSERT_EQ(fragment(root["users"].at(3)["profile"]), nullptr);
+
+    // the cached text is spliced
+    ASSERT_EQ(json::stringify(root, options), json::stringify(root, format));
+    ASSERT_EQ(json::serialized_size(root, options), json::stringify(root, format).size());
+
+    // a modified copy shares the fragments of the parts left untouched
+    auto user_fragment = fragment(root["users"].at(3));
+    json::Json copy = root;
+    copy["status"]["load"] = 0.75;
+    json::Frozen next = json::freeze(copy);
+    ASSERT_EQ(next.json()["users"].impl(), root["users"].impl());
+    ASSERT_EQ(json::stringify(next.json(), options), json::stringify(next.json(), format));
+    ASSERT_EQ(fragment(root["users"].at(3)), user_fragment);
+    ASSERT_EQ(json::stringify(root, options), json::stringify(root, format));
+  }
+
+  // the same subtree written at different depths and with other formats
+  json::Json shared = json::freeze(json::Object{ { "values", json::Array{ 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 } }, { "label", "shared" } }).json();
+  json::Frozen twice = json::freeze(json::Object{ { "x", shared }, { "y", json::Object{ { "z", shared } } } });
+  ASSERT_EQ(twice.json()["x"].impl(), twice.json()["y"]["z"].impl());
+  ASSERT_EQ(json::stringify(twice.json(), json::CacheFragments), json::stringify(twice.json()));
+  ASSERT_EQ(json::stringify(twice.json(), json::PrettyFormat(4), json::CacheFragments), json::stringify(twice.json(), json::PrettyFormat(4)));
+  ASSERT_EQ(json::stringify(twice.json(), json::Compact | json::CacheFragments), json::stringify(twice.json(), json::Compact));
+  ASSERT_EQ(json::stringify(twice.json(), json::Compact | json::AsciiOnly | json::CacheFragments), json::stringify(twice.json(), json::Compact | json::AsciiOnly));
+
+  std::ostringstream out;
+  json::stringify_to(out, twice.json(), json::CacheFragments);
+  ASSERT_EQ(out.str(), json::stringify(twice.json()));
+}
+
+TEST(jsontest, parallelStringify)
+{
+  json::Json records = json::Array();
+  for (int i(0); i < 5000; ++i)
+    records.push(json::Object{ { "id", i }, { "name", "r\xc3\xa9" "cord " + std::to_string(i) }, { "values", json::Array{ i, 0.5 * i } } });
+
+  json::Json fields = json::Object();
+  for (int i(0); i < 3000; ++i)
+    fields["key" + std::to_string(i)] = json::Array{ i, json::Object{ { "x", i } } };
+
+  for (json::StringifyOptions options : { json::None, json::Compact, json::Compact | json::AsciiOnly, json::CacheFragments })
+  {
+    ASSERT_EQ(json::stringify_parallel(records, options, 4), json::stringify(records, options));
+    ASSERT_EQ(json::stringify_parallel(fields, options, 3), json::stringify(fields, options));
+  }
+
+  // fragments recorded by the chunks are tagged with the depth of the items
+  json::Frozen frozen = json::freeze(records);
+  for (json::StringifyOptions format : { json::None, json::Compact })
+  {
+    const json::StringifyOptions options = format | json::CacheFragments;
+    ASSERT_EQ(json::stringify_parallel(frozen.json(), options, 4), json::stringify(records, format));
+    ASSERT_EQ(json::stringify_parallel(frozen.json(), options, 4), json::stringify(records, format));
+    ASSERT_EQ(json::stringify(frozen.json().at(1), options), json::stringify(records.at(1), format));
+    ASSERT_EQ(json::stringify(frozen.json(), options), json::stringify(records, format));
+  }
+
+  // small documents are written by a single thread
+  json::Json small = json::Array{ 1, 2, 3 };
+  ASSERT_EQ(json::stringify_parallel(small, json::Compact, 4), "[1,2,3]");
+  ASSERT_EQ(json::stringify_parallel(json::Json(42)), "42");
+
+#ifndef _WIN32
+  FILE* file = std::tmpfile();
+  ASSERT_NE(file, nullptr);
+  json::stringify_parallel_to_fd(fileno(file), records, json::Compact, 4);
+
+  std::string content;
+  std::rewind(file);
+  char buffer[4096];
+  size_t n;
+  while ((n = std::fread(buffer, 1, sizeof(buffer), file)) > 0)
+    content.append(buffer, n);
+  std::fclose(file);
+
+  ASSERT_EQ(content, json::stringify(records, json::Compact));
+#endif // !_WIN32
+}